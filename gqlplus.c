@@ -450,6 +450,11 @@ Copyright (C) 2004 Ljubomir J. Buturovic. All Rights Reserved.
 #include <sys/wait.h>
 #include <errno.h>
 #include <sys/stat.h>
+#include <sys/mman.h>
+#include <sys/time.h>
+#include <poll.h>
+#include <stdint.h>
+#include <time.h>
 #include <readline/readline.h>
 #include <readline/history.h>
 
@@ -493,21 +498,50 @@ Copyright (C) 2004 Ljubomir J. Buturovic. All Rights Reserved.
 #define SET_CMD          "set"
 #define SQLPROMPT_CMD    "sqlprompt"
 #define PAUSE_CMD        "pause"
+#define PAUSE_OFF_CMD    "set pause off"
 #define SELECT_CMD       "select"
 #define CONNECT_CMD      "connect"
 #define DISCONNECT_CMD   "disconnect"
 #define QUIT_CMD         "quit"
+#define EXIT_CMD         "exit"
 #define ON_CMD           "on"
 #define PAGESIZE_CMD     "show pagesize\n"
 #define ACCEPT_CMD       "accept"
+#define ACCEPT_WAIT      5000 /* ms sqlplus gets to answer an ACCEPT */
+#define ACCEPT_SETTLE    200  /* ms of silence that ends an unpredictable prompt */
+#define FINAL_WAIT       5000 /* ms sqlplus gets to exit after we are done */
 #define GET_PROMPT       "echo \"show sqlprompt;\" | "
 #define TAIL_PROMPT      ""
 #define SELECT_TABLES_1  "select distinct table_name, owner from all_tables where owner != 'SYS' union "
 #define SELECT_TABLES_2  "select distinct view_name, owner from all_views where owner != 'SYS';\n"
+#define SELECT_STATS     "select table_name||' '||owner||' '||num_rows||' '||blocks from all_tables where owner != 'SYS' and num_rows is not null;\n"
+#define WARN_ROWS        1000000 /* default --!warn threshold */
+#define WARN_FETCH       100     /* rows FETCH FIRST asks for, without --!limit */
+#define BATCH_CHUNK      65536   /* largest read or write in batch mode */
+#define BATCH_LINE       256     /* as much of a line as batch mode checks for errors */
+#define BATCH_WHENEVER   "whenever sqlerror exit failure rollback\nwhenever oserror exit failure rollback\n"
+#define TASK_CONNECT     "whenever sqlerror exit failure\nconnect %s\nwhenever sqlerror continue none\n"
+#define SESSION_MARK     "gqlplus-session-mark"
+#define SESSION_LOGIN    "prompt " SESSION_MARK "1\n" TASK_CONNECT "prompt " SESSION_MARK "2\n"
+#define FANOUT_WORKERS   8       /* --fanout without --parallel */
+#define FANOUT_SETTINGS  "set pagesize 0 linesize 32767 trimout on heading off feedback off verify off echo off\n"
+#define CAPTURE_HEADER   "-- gqlplus capture"
+#define REPLAY_MARK      "gqlplus-replay-done"
+#define REPLAY_TOP       20      /* statements in the replay report */
+#define WATCH_TOP        2       /* screen line of the first --!watch result line */
+#define FNV_BASIS        2166136261u
+#define FNV_PRIME        16777619u
+#define EXPORT_WORKERS   4       /* --!export without PARALLEL */
+#define EXPORT_RANGES    4       /* ROWID ranges per worker */
+#define EXPORT_ROWID     19
+#define EXPORT_NAME_CHARS "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789_$#."
+#define EXPORT_SETTINGS  "set pagesize 0 linesize 32767 trimout on trimspool on heading off feedback off verify off echo off arraysize 1000 long 2000000000 longchunksize 32767\nset markup csv on quote on\n"
+#define EXPORT_RANGES_SQL "select 'RANGE '||dbms_rowid.rowid_create(1, data_object_id, lo_fno, lo_block, 0)||' '||dbms_rowid.rowid_create(1, data_object_id, hi_fno, hi_block, 32767) from (select data_object_id, grp, min(relative_fno) keep (dense_rank first order by relative_fno, block_id) lo_fno, min(block_id) keep (dense_rank first order by relative_fno, block_id) lo_block, max(relative_fno) keep (dense_rank last order by relative_fno, block_id) hi_fno, max(block_id+blocks-1) keep (dense_rank last order by relative_fno, block_id) hi_block from (select o.data_object_id, e.relative_fno, e.block_id, e.blocks, trunc((sum(e.blocks) over (order by o.data_object_id, e.relative_fno, e.block_id)-0.5)*%d/sum(e.blocks) over ()) grp from dba_extents e, all_objects o where e.owner = %s and e.segment_name = '%s' and e.segment_type like 'TABLE%%' and o.owner = e.owner and o.object_name = e.segment_name and nvl(o.subobject_name, ' ') = nvl(e.partition_name, ' ') and o.object_type like 'TABLE%%') group by data_object_id, grp) order by data_object_id, grp;\n"
 #define DESCRIBE         "describe"
 #define VI_EDITOR        "/bin/vi"
 #define EDITOR           "_editor"
 #define AFIEDT           "afiedt.buf"
+#define GET_CMD          "get " AFIEDT "\n"
 #define NO_LINES         "No lines in SQL buffer.\n"
 #define NOTHING_TO_SAVE  "Nothing to save.\n"
 #define AFIEDT_ERRMSG    "Cannot create save file \"afiedt.buf\"\n"
@@ -541,2121 +575,6690 @@ Copyright (C) 2004 Ljubomir J. Buturovic. All Rights Reserved.
   static  pid_t  sqlplus_pid;
   static  pid_t  edit_pid;
   static  int    quit_sqlplus = 0;
+  static  int    sqlplus_killed = 0; /* we sent it SIGTERM */
   static  int    complete_columns = 1; /* if 0, don't do column name completion */
   struct  sigaction iact;
   struct  sigaction qact;
   struct  sigaction cact;
   struct  sigaction pact;
+  struct  sigaction aact;
   static  FILE   *lptr;
   static  char   *sql_prompt = (char *) 0; /* user-defined prompt */
+  static  int    pause_mode;    /* SET PAUSE ON: pause_cmd() pages queries */
   static  char   *username = (char *) 0;
+  static  long long out_bytes;  /* sqlplus output for the current statement: bytes, */
+  static  long long out_rows;   /* rows reported, */
+  static  int    out_error;     /* first ORA- error */
+  static  int    pending_prompts; /* continuation prompts get_sqlplus() swallows */
+  static  volatile sig_atomic_t sqlplus_busy;     /* a statement is running */
+  static  volatile sig_atomic_t cancel_requested; /* Ctrl-C typed while it was */
+  static  volatile sig_atomic_t interrupts;       /* Ctrl-C typed so far */
+  static  long long discarded_bytes; /* output dropped after a cancel: bytes, */
+  static  long long discarded_lines; /* and lines */
+  static  int    statement_timeout; /* seconds a statement may run, 0 for no limit */
+  static  double timeout_armed;      /* when the timer was last armed */
+  static  volatile sig_atomic_t timed_out;
+  static  long long row_limit;     /* rows a query may display, 0 for no limit */
+  static  long long byte_limit;    /* bytes a query may display, 0 for no limit */
+  static  int    limit_armed;      /* the running query is subject to the limits */
+  static  int    limit_hit;        /* ... and has reached one of them */
+  static  int    in_rows;          /* output is past a column heading separator */
+  static  int    line_kind;        /* current output line has: 1 dashes, 2 other text */
+  static  long long shown_rows;    /* rows and bytes of the query displayed so far */
+  static  long long shown_bytes;
+  static  char   *limit_stmt = (char *) 0; /* the query that hit the limit */
+  static  long long limit_offset;  /* rows of it displayed, for --!more */
+  static  long long warn_rows = WARN_ROWS; /* table size check_full_scan() warns about */
+  static  char   *sql_buffer = (char *) 0; /* local copy of the SQL buffer, null if unknown */
+  static  FILE   *capture_file = (FILE *) 0; /* see capture_statement() */
+  static  double capture_end;      /* when the last statement captured ended */
 
 
   static char* szCmdPrefix = "--!";
-  static char *histname;
-  static int histmax = 200;
-
-void save_history(void)
+/*
+   Get current time information. Utility function to display time
+   information in the prompt. Contributed by Mark Harrison of Pixar.
+   */
+static double now()
 {
-  if (history_list() == NULL)
-    /* If history is of length 0 (because set as is or slave is not executable) */
-    unlink(histname);
-  else {
-    write_history(histname);
-    chmod(histname, 0600);
-    printf("\nSession history saved to: %s\n", histname);
-  }
+  struct timeval tod;
+  gettimeofday(&tod, NULL);
+  return tod.tv_sec + (tod.tv_usec/1000000.0);
 }
 
-void initialize_history(char *appl_name)
+/*
+   The history file is a sequence of binary records, one per statement,
+   shared by all gqlplus sessions of a user. Besides the statement, each
+   record keeps the time it was sent, the connect identity, the elapsed
+   time, the rows and bytes returned and the ORA- error, so that
+   `--!slow' can answer "what was slow yesterday". Records are 8-byte
+   aligned and end with a copy of their length, so the file can be
+   mmap()ed and walked backwards: loading the last `histmax' statements
+   costs the same regardless of the size of the file. A plain-text
+   ~/.sqlplus_history from older versions is imported into the new
+   ~/.sqlplus_history.db on first use.
+
+   Every statement is appended as soon as sqlplus has answered it, under an
+   exclusive fcntl() lock, so nothing is lost if gqlplus dies and
+   concurrent sessions don't overwrite each other. When the file has doubled
+   in size, a background child rewrites it with only the last
+   `histkeep' records and renames it into place.
+
+   hist_offset is the end of the part of the file this session has
+   seen; records beyond it were written by other sessions (or by us,
+   after them - those offsets are kept in hist_own) and are picked up
+   by merge_history(). A different inode means the file was compacted
+   in the meantime, in which case merge_history() reloads it.
+   */
+#define HIST_MAGIC       0x31485147 /* "GQH1" */
+#define HIST_COMPACT_MIN 1048576 /* don't bother compacting smaller history files */
+#define HIST_ALIGN(n)    (((n)+7) & ~7)
+#define HIST_TRAILER     sizeof(uint32_t)
+#define HIST_SLOW_HOURS  24
+#define HIST_SLOW_COUNT  10
+
+struct hist_record
 {
-  char buffer[MAXPATHLEN];
+  uint32_t magic;
+  uint32_t length;    /* whole record: header, identity, text, padding, trailer */
+  int64_t  start;     /* when the statement was sent, seconds since the Epoch */
+  int64_t  rows;      /* rows returned or affected, -1 if unknown */
+  int64_t  bytes;     /* bytes of sqlplus output */
+  int32_t  elapsed;   /* milliseconds, -1 until sqlplus answers */
+  int32_t  error;     /* ORA- error number, 0 if none */
+  uint32_t ident_len; /* connect identity (user@service), follows the header */
+  uint32_t text_len;  /* statement, follows the identity */
+};
 
-  /* Find the real name of the history file using the tilde_expand function 
-   * which is in the readline library.
+  static char   *histname;
+  static int    histmax = 200;     /* statements kept in readline history */
+  static int    histkeep = 100000; /* statements kept in the history file */
+  static char   *hist_ident = (char *) 0;
+  static off_t  hist_offset;
+  static ino_t  hist_inode;
+  static off_t  hist_compact_size;
+  static pid_t  compact_pid;
+  static off_t  *hist_own = (off_t *) 0;
+  static int    hist_nown = 0;
+  static int    hist_cown = 0;
+  static off_t  hist_pending = -1; /* record waiting for its metadata */
+  static ino_t  hist_pending_inode;
+  static struct hist_record hist_pending_rec;
+
+/*
+   `connect_string' without the password, if any.
    */
-  sprintf(buffer, "~/.%s_history", appl_name);
-  histname = tilde_expand(buffer);
+static char *connect_identity(const char *connect_string)
+{
+  char *ident;
+  const char *pw;
+  const char *at;
 
-  using_history();  
-  if (histmax >= 0) {
-    stifle_history(histmax);
-    atexit(save_history);
-    read_history(histname);
-  } else {
-    max_input_history = -histmax;
+  pw = strchr(connect_string, '/');
+  at = strchr(connect_string, '@');
+  if (pw && (!at || (pw < at)))
+  {
+    ident = malloc(strlen(connect_string)+1);
+    memcpy(ident, connect_string, pw-connect_string);
+    strcpy(ident+(pw-connect_string), at ? at : "");
   }
+  else
+    ident = strdup(connect_string);
+  return ident;
 }
 
 /*
-   Remove leading and trailing spaces from str.
+   Remember the connect identity recorded with each statement. The
+   password, if any, is stripped from `connect_string'.
    */
-static char *trim(char *str)
+static void set_history_identity(const char *connect_string)
 {
-  int  len;
-  char *xtr = (char *) 0;
-
-  if (str){
-    len = strlen(str)-1;
-    while (str[len] == ' '){
-      str[len--] = '\0';
-    }
-    xtr = strdup(str+strspn(str, " "));
-  }
-  return xtr;
+  free(hist_ident);
+  hist_ident = (char *) 0;
+  if (connect_string)
+    hist_ident = connect_identity(connect_string);
+  else if (username)
+    hist_ident = strdup(username);
 }
 
-
-/* 
-   Returns 1 if a string szOrg starts with szPrefix.
-   Note that leading blanks/tabs are ignored.
-
-   Returns 0 otherwise.
-
-   @param szOrg can be NULL.
-   @param szPrefix can be NULL.
+/*
+   Return the offset of the record ending at `end' in the history file
+   image `map', or -1 if there is no valid record there.
    */
-int startsWith(char* szOrg, const char* szPrefix)
+static off_t hist_prev_record(const char *map, off_t end)
 {
-
-  int iMatch = 0;
-  if ((szOrg  == (char*) 0) || (szPrefix == (char*) 0)) {
-    /* do nothing. */
-  }else {
-    char* szOrgTrimmed = trim(szOrg);
-    if (strstr(szOrgTrimmed, szPrefix) == szOrgTrimmed){
-      iMatch = 1;
-    }
-  }
-  return iMatch;
+  uint32_t len;
+  struct hist_record rec;
+
+  if (end < (off_t) (sizeof(rec)+HIST_TRAILER))
+    return -1;
+  memcpy(&len, map+end-HIST_TRAILER, HIST_TRAILER);
+  if ((len < sizeof(rec)+HIST_TRAILER) || (len > end) || (len & 7))
+    return -1;
+  memcpy(&rec, map+end-len, sizeof(rec));
+  if ((rec.magic != HIST_MAGIC) || (rec.length != len))
+    return -1;
+  return end-len;
 }
 
-
 /*
-   Return 1 if the following conditions satisfy:
-   a) current line startsWith szPrefix AND
-   b) the remaining part after szPrefix in szOrg starts with szCmd
-
-   Return 0 otherwise.
+   Validate the record at `*pos' in the history file image `map' of
+   `size' bytes. If there is none there, as after a write torn by a
+   gqlplus that was killed, move `*pos' on to the next valid record.
+   Return its length, or 0 if there are no more.
    */
-int matchCommand(char* szOrg, char* szPrefix, char* szCmd)
+static uint32_t hist_next_record(const char *map, off_t size, off_t *pos, struct hist_record *rec)
 {
-  int iMatch = 0;
+  uint32_t len;
 
-  if ((szOrg    == (char*) 0) || (szPrefix == (char*) 0) || (szCmd    == (char*) 0)) {
-    /* do nothing. */
-  }else {
-    char* szOrgTrimmed = trim(szOrg);
-    if (strstr(szOrgTrimmed, szPrefix) == szOrgTrimmed) {
-      char* szRemaining = szOrgTrimmed + strlen(szPrefix);
-      iMatch = startsWith(szRemaining, szCmd);
-    }
+  for (; *pos+(off_t) sizeof(*rec) <= size; (*pos)++)
+  {
+    memcpy(rec, map+*pos, sizeof(*rec));
+    if ((rec->magic != HIST_MAGIC) || (rec->length & 7) || (*pos+rec->length > size) ||
+        (sizeof(*rec)+rec->ident_len+rec->text_len+HIST_TRAILER > rec->length))
+      continue;
+    memcpy(&len, map+*pos+rec->length-HIST_TRAILER, HIST_TRAILER);
+    if (len == rec->length)
+      return len;
   }
-
-  return iMatch;
+  return 0;
 }
 
-
 /*
-   Return lowercase and trimmed version of 'str'.
+   Return the offset of the first of the last `n' records of the history
+   file image `map' of `size' bytes. Torn records are stepped over.
    */
-char *tl(const char *str)
+static off_t hist_tail(const char *map, off_t size, int n)
 {
-  int  i;
-  char *xtr = (char *) 0;
-  char *lline = (char *) 0;
+  off_t start;
+  off_t prev;
 
-  if (str){
-    lline = strdup(str);
-    for (i = 0; i < strlen(str); i++){
-      lline[i] = tolower((int) lline[i]);
+  start = size;
+  while ((n > 0) && (start > 0))
+  {
+    if ((prev = hist_prev_record(map, start)) >= 0)
+    {
+      start = prev;
+      n--;
     }
+    else
+      start--;
   }
-  xtr = trim(lline);
-  free(lline);
-  return xtr;
+  return start;
 }
 
 /*
-   Set 'str' to lowercase.
+   Build the history record for statement `text'. The caller frees it.
    */
-static void tl2(char *str)
+static char *hist_build_record(const char *text, const char *ident, time_t start, struct hist_record *rec)
 {
-  if (!str){
-    return;
-  }
-  int  i = 0;
-  while (str[i] != '\0'){
-    str[i] = tolower((int) str[i]);
-    i++;
-  }
+  uint32_t len;
+  char     *buffer;
+
+  memset(rec, 0, sizeof(*rec));
+  rec->magic = HIST_MAGIC;
+  rec->start = start;
+  rec->rows = -1;
+  rec->elapsed = -1;
+  rec->ident_len = ident ? strlen(ident) : 0;
+  rec->text_len = strlen(text);
+  len = HIST_ALIGN(sizeof(*rec)+rec->ident_len+rec->text_len+HIST_TRAILER);
+  rec->length = len;
+  buffer = calloc(len, sizeof(char));
+  memcpy(buffer, rec, sizeof(*rec));
+  if (rec->ident_len)
+    memcpy(buffer+sizeof(*rec), ident, rec->ident_len);
+  memcpy(buffer+sizeof(*rec)+rec->ident_len, text, rec->text_len);
+  memcpy(buffer+len-HIST_TRAILER, &len, HIST_TRAILER);
+  return buffer;
 }
 
 /*
-   Utility function for check_numeric_prompt().
+   Inline suggestions: while the cursor is at the end of the line, the
+   most recent earlier statement starting with what has been typed so
+   far is shown dimmed after the cursor; the right arrow key accepts it.
+
+   Statements are kept sorted, without duplicates, together with a
+   sequence number (higher is more recent) and a tree holding the most
+   recent statement of each range, so the most recent statement with a
+   given prefix is found in O(log n) time. Statements entered after the
+   index was built go to a small unsorted array first, which is merged
+   into the sorted one when it fills up.
    */
+#define SUGGEST_RECENT   64
 
-static int check_numeric(const char *str)
+struct suggestion
 {
-  int check_prompt = 0;
+  const char *text;
+  int        len;
+  int        seq;
+};
 
-  if (strlen(str) == 5)
-    if (isspace((int) str[4]))
-      if (isspace((int) str[3]) || (str[3] == '*') || (str[3] == 'i'))
-        if (isdigit((int) str[2]))
-        {
-          check_prompt = 1;
-          if (isdigit((int) str[0]) && isspace((int) str[1]))
-            check_prompt = 0;
-        }
-  return check_prompt;
+  static int    suggest_enabled = 1;
+  static int    suggest_active;      /* readline prompt accepts suggestions */
+  static int    suggest_built;
+  static int    suggest_seq;
+  static struct suggestion *suggestions = (struct suggestion *) 0;
+  static int    nsuggestions;
+  static int    *suggest_tree = (int *) 0;
+  static struct suggestion suggest_recent[SUGGEST_RECENT];
+  static int    nrecent;
+  static const char *ghost = (const char *) 0;
+  static int    ghost_len;
+  static int    ghost_shown;
+  static int    ghost_hold;
+
+/*
+   Order suggestions by text; equal texts by sequence number.
+   */
+static int suggest_compare(const void *p1, const void *p2)
+{
+  const struct suggestion *s1 = p1;
+  const struct suggestion *s2 = p2;
+  int   result;
+
+  result = memcmp(s1->text, s2->text, (s1->len < s2->len) ? s1->len : s2->len);
+  if (!result)
+    result = (s1->len != s2->len) ? s1->len-s2->len : s1->seq-s2->seq;
+  return result;
 }
 
 /*
-   Return 1 if 'str' is a correct Oracle numeric prompt. The numeric
-   prompt has up to three numeric characters, followed by a space, or
-   an asterisk, or an 'i' (for Insert command).
+   Rebuild the tree: node i holds the index of the most recent
+   suggestion below it, leaves are at nsuggestions+i.
+   */
+static void suggest_build_tree(void)
+{
+  int i;
+  int l;
+  int r;
 
-   ljb, 06/16/2004: there is another version of a numeric prompt, when
-   'time' is set. The prompt looks like this:
+  suggest_tree = realloc(suggest_tree, 2*(nsuggestions+1)*sizeof(int));
+  for (i = 0; i < nsuggestions; i++)
+    suggest_tree[nsuggestions+i] = i;
+  for (i = nsuggestions-1; i > 0; i--)
+  {
+    l = suggest_tree[2*i];
+    r = suggest_tree[2*i+1];
+    suggest_tree[i] = (suggestions[l].seq > suggestions[r].seq) ? l : r;
+  }
+}
 
-   SQL> set time on
-19:41:37 SQL> select * from scott.salgrade
-19:41:42   2  ;
-*/
-static int check_numeric_prompt(const char *str)
+/*
+   Sort `n' suggestions, drop all but the most recent of equal texts
+   and rebuild the tree.
+   */
+static void suggest_sort(int n)
 {
-  if (!str){
-     return 0;
+  int i;
+  int j;
+
+  qsort(suggestions, n, sizeof(struct suggestion), suggest_compare);
+  for (i = j = 0; i < n; i++)
+  {
+    if ((i+1 < n) && (suggestions[i].len == suggestions[i+1].len) &&
+        !memcmp(suggestions[i].text, suggestions[i+1].text, suggestions[i].len))
+      continue;
+    suggestions[j++] = suggestions[i];
   }
-  int check_prompt = 0;
-    /*
-       Check for the short version of the numeric prompt:
-       */
-    if (strlen(str) == 5){
-      check_prompt = check_numeric(str);
-    /*
-       Check for the long version of the numeric prompt (when time is set):
-       */
-    }else if (strlen(str) == 14){
-      if (isdigit((int) str[0]) && isdigit((int) str[1]) &&
-          str[2] == ':' && isdigit((int) str[3]) && isdigit((int) str[4]) &&
-          str[5] == ':' && isdigit((int) str[6]) && isdigit((int) str[7]) &&
-          isspace((int) str[8]))
-        check_prompt = check_numeric(str+9);
-    }
-    return check_prompt;
+  nsuggestions = j;
+  suggest_build_tree();
 }
 
 /*
-   Return 1 if 'str' is a correct Oracle time prompt. The time prompt
-   has time followed by a space followed by `sqlprompt', like this:
+   Merge the recent statements into the sorted array. Texts are never
+   freed: an older copy of a statement may still be shown.
+   */
+static void suggest_merge(void)
+{
+  int i;
 
-19:41:37 SQL>
-*/
-static int check_time_prompt(char *str, char *sqlprompt)
+  suggestions = realloc(suggestions, (nsuggestions+nrecent)*sizeof(struct suggestion));
+  for (i = 0; i < nrecent; i++)
+    suggestions[nsuggestions+i] = suggest_recent[i];
+  suggest_sort(nsuggestions+nrecent);
+  nrecent = 0;
+}
+
+/*
+   Index every statement of the history file. The statements are read
+   from a mapping of the file; those left once duplicates are dropped
+   are copied to a single block, and the mapping is released.
+   */
+static void suggest_build(void)
 {
-  if (!str){
-    return 0;
-  }
-  int check_prompt = 0;
-  if (isdigit((int) str[0]) && isdigit((int) str[1]) &&
-      str[2] == ':' && isdigit((int) str[3]) && isdigit((int) str[4]) &&
-      str[5] == ':' && isdigit((int) str[6]) && isdigit((int) str[7]) &&
-      isspace((int) str[8]) && !strcmp(&str[9], sqlprompt)){
-        check_prompt = 1;
+  int      fd;
+  int      i;
+  int      n;
+  int      size;
+  uint32_t len;
+  off_t    pos;
+  size_t   total;
+  char     *map;
+  char     *texts;
+  struct stat fbuf;
+  struct hist_record rec;
+
+  suggest_built = 1;
+  fd = open(histname, O_RDONLY);
+  if (fd < 0)
+    return;
+  if (!fstat(fd, &fbuf) && (fbuf.st_size > 0) &&
+      ((map = mmap((void *) 0, fbuf.st_size, PROT_READ, MAP_PRIVATE, fd, 0)) != MAP_FAILED))
+  {
+    n = 0;
+    size = INIT_LENGTH;
+    suggestions = malloc(size*sizeof(struct suggestion));
+    for (pos = 0; (len = hist_next_record(map, fbuf.st_size, &pos, &rec)); pos += len)
+    {
+      if (!rec.text_len)
+        continue;
+      if (n == size)
+      {
+        size += size;
+        suggestions = realloc(suggestions, size*sizeof(struct suggestion));
+      }
+      suggestions[n].text = map+pos+sizeof(rec)+rec.ident_len;
+      suggestions[n].len = rec.text_len;
+      suggestions[n].seq = ++suggest_seq;
+      n++;
+    }
+    suggest_sort(n);
+    for (total = 0, i = 0; i < nsuggestions; i++)
+      total += suggestions[i].len;
+    texts = malloc(total+1);
+    for (total = 0, i = 0; i < nsuggestions; i++)
+    {
+      memcpy(texts+total, suggestions[i].text, suggestions[i].len);
+      suggestions[i].text = texts+total;
+      total += suggestions[i].len;
+    }
+    munmap(map, fbuf.st_size);
   }
-  return check_prompt;
+  close(fd);
 }
 
-void ignore_sigint()
+/*
+   Add statement `text', just entered or merged from another session,
+   to the index.
+   */
+static void suggest_add(const char *text)
 {
-  sigemptyset(&iact.sa_mask);
-  iact.sa_flags = 0;
-#ifdef SA_RESTART
-  iact.sa_flags |= SA_RESTART;
-#endif
-  iact.sa_handler = SIG_IGN;
-  sigaction(SIGINT, &iact, (struct sigaction *) 0);
+  if (!suggest_built || !*text)
+    return;
+  if (nrecent == SUGGEST_RECENT)
+    suggest_merge();
+  suggest_recent[nrecent].text = strdup(text);
+  suggest_recent[nrecent].len = strlen(text);
+  suggest_recent[nrecent].seq = ++suggest_seq;
+  nrecent++;
 }
 
-static void ignore_sigpipe()
+/*
+   Return the most recent statement that is longer than, and starts
+   with, the `len' characters at `prefix'.
+   */
+static struct suggestion *suggest_lookup(const char *prefix, int len)
 {
-  sigemptyset(&pact.sa_mask);
-  pact.sa_flags = 0;
-#ifdef SA_RESTART
-  pact.sa_flags |= SA_RESTART;
-#endif
-  pact.sa_handler = SIG_IGN;
-  sigaction(SIGPIPE, &pact, (struct sigaction *) 0);
+  int i;
+  int lo;
+  int hi;
+  int mid;
+  int best;
+
+  if (!suggest_built)
+    suggest_build();
+  for (i = nrecent-1; i >= 0; i--)
+    if ((suggest_recent[i].len > len) && !memcmp(suggest_recent[i].text, prefix, len))
+      return &suggest_recent[i];
+  /*
+     The statements starting with `prefix' are in [lo, hi).
+     */
+  lo = 0;
+  hi = nsuggestions;
+  while (lo < hi)
+  {
+    mid = (lo+hi)/2;
+    i = memcmp(suggestions[mid].text, prefix, (suggestions[mid].len < len) ? suggestions[mid].len : len);
+    if ((i < 0) || (!i && (suggestions[mid].len < len)))
+      lo = mid+1;
+    else
+      hi = mid;
+  }
+  hi = nsuggestions;
+  mid = lo;
+  while (mid < hi)
+  {
+    i = (mid+hi)/2;
+    if ((suggestions[i].len >= len) && !memcmp(suggestions[i].text, prefix, len))
+      mid = i+1;
+    else
+      hi = i;
+  }
+  hi = mid;
+  best = -1;
+  for (lo += nsuggestions, hi += nsuggestions; lo < hi; lo /= 2, hi /= 2)
+  {
+    if (lo & 1)
+    {
+      i = suggest_tree[lo++];
+      if ((best < 0) || (suggestions[i].seq > suggestions[best].seq))
+        best = i;
+    }
+    if (hi & 1)
+    {
+      i = suggest_tree[--hi];
+      if ((best < 0) || (suggestions[i].seq > suggestions[best].seq))
+        best = i;
+    }
+  }
+  if ((best < 0) || (suggestions[best].len == len))
+    return (struct suggestion *) 0;
+  return &suggestions[best];
 }
 
 /*
-   SIGINT handler. Passes the signal to the child (i.e., sqlplus)
-   unless we are in the middle of an editing session (edit_pid !=
-   0). The reason is this: Emacs redefines Ctrl-G to be
-   SIGINT-generating key (instead of Ctrl-C). So, during Emacs editing
-   session, Ctrl-G generates SIGINT which we don't want to pass to
-   sqlplus because it disrupts its' operation and does not make sense
-   anyway (that is not the interrupt we want to catch; we only care
-   about Ctrl-C typed at gqlplus prompt).
+   rl_redisplay_function: let readline draw the line, then the dimmed
+   rest of the suggestion, up to the end of its first line and of the
+   screen line, moving the cursor back over it. The previous suggestion
+   is erased first if the line changed under it.
    */
-static void sigint_handler(int signo)
+static void suggest_redisplay(void)
 {
-  if (edit_pid == 0)
+  int  rows;
+  int  cols;
+  int  col;
+  int  n;
+  const char *p;
+  struct suggestion *s;
+
+  ghost = (const char *) 0;
+  if (suggest_active && !ghost_hold && (rl_end > 0) && (rl_point == rl_end) &&
+      !RL_ISSTATE(RL_STATE_ISEARCH | RL_STATE_NSEARCH) &&
+      (s = suggest_lookup(rl_line_buffer, rl_end)))
   {
-    kill(sqlplus_pid, SIGINT);
-    //ignore_sigint();
+    ghost = s->text+rl_end;
+    ghost_len = s->len-rl_end;
+  }
+  rl_redisplay();
+  if (ghost_shown)
+  {
+    if (rl_point == rl_end)
+      fputs("\033[K", rl_outstream);
+    else
+      fprintf(rl_outstream, "\0337\033[%dC\033[K\0338", rl_end-rl_point);
+    ghost_shown = 0;
+  }
+  if (ghost)
+  {
+    rl_get_screen_size(&rows, &cols);
+    for (n = rl_end; (n > 0) && (rl_line_buffer[n-1] != '\n'); n--)
+      ;
+    if (n > 0)
+      col = rl_end-n;
+    else
+    {
+      p = strrchr(rl_prompt, '\n');
+      col = strlen(p ? p+1 : rl_prompt)+rl_end;
+    }
+    col = (cols > 0) ? col % cols : 0;
+    for (n = 0; (n < ghost_len) && (ghost[n] != '\n') && (col+n < cols-1); n++)
+      ;
+    if (n > 0)
+    {
+      fprintf(rl_outstream, "\033[2m%.*s\033[0m\033[%dD", n, ghost, n);
+      ghost_shown = 1;
+    }
   }
+  fflush(rl_outstream);
 }
 
-   //SIGQUIT handler.
-static void sigquit_handler(int signo)
+/*
+   Right arrow: accept the suggestion shown, or move forward.
+   */
+static int suggest_accept(int count, int key)
 {
-  kill(sqlplus_pid, signo);
-  printf("Quit\n");
-  _exit(0);
+  char *text;
+
+  if (!ghost || (rl_point != rl_end))
+    return rl_forward_char(count, key);
+  text = malloc((ghost_len+1)*sizeof(char));
+  memcpy(text, ghost, ghost_len);
+  text[ghost_len] = '\0';
+  rl_insert_text(text);
+  free(text);
+  return 0;
 }
 
-void install_sigint_handler()
+/*
+   Return: erase the suggestion shown before the line is accepted.
+   */
+static int suggest_newline(int count, int key)
 {
-  sigemptyset(&iact.sa_mask);
-  iact.sa_flags = 0;
-#ifdef SA_RESTART
-  iact.sa_flags |= SA_RESTART;
-#endif
-     //Use sigaction(), for portability and reliability.
-  iact.sa_handler = sigint_handler;
-  sigaction(SIGINT, &iact, (struct sigaction *) 0);
+  int result;
+
+  ghost_hold = 1;
+  if (ghost_shown)
+    suggest_redisplay();
+  result = rl_newline(count, key);
+  ghost_hold = 0;
+  return result;
 }
 
-void install_sigquit_handler()
+/*
+   Take over Return and Newline in `map', unless the init file bound
+   them to something else.
+   */
+static void suggest_bind_newline(Keymap map)
 {
-  sigemptyset(&qact.sa_mask);
-  qact.sa_flags = 0;
-#ifdef SA_RESTART
-  qact.sa_flags |= SA_RESTART;
-#endif
-     //Use sigaction(), for portability and reliability.
-  qact.sa_handler = sigquit_handler;
-  sigaction(SIGQUIT, &qact, (struct sigaction *) 0);
+  if ((map['\r'].type == ISFUNC) && (map['\r'].function == rl_newline))
+    rl_bind_key_in_map('\r', suggest_newline, map);
+  if ((map['\n'].type == ISFUNC) && (map['\n'].function == rl_newline))
+    rl_bind_key_in_map('\n', suggest_newline, map);
 }
 
-// Install signal handlers.
-void sig_init(void)
+/*
+   rl_startup_hook: bind the keys once readline has read its init file,
+   and install the redisplay function only now, since readline does not
+   initialize the terminal for a custom redisplay function.
+   */
+static int suggest_bind_keys(void)
 {
-  if (getenv("EMACS_MODE")){
-    printf("Operating in Emacs mode.\nUnset EMACS_MODE if this is not desired.\n");
-    install_sigint_handler();
+  static int bound = 0;
+
+  if (!bound)
+  {
+    bound = 1;
+    rl_redisplay_function = suggest_redisplay;
+    rl_set_key("\033[C", suggest_accept, emacs_standard_keymap);
+    rl_set_key("\033OC", suggest_accept, emacs_standard_keymap);
+    rl_set_key("\033[C", suggest_accept, vi_insertion_keymap);
+    rl_set_key("\033OC", suggest_accept, vi_insertion_keymap);
+    suggest_bind_newline(emacs_standard_keymap);
+    suggest_bind_newline(vi_insertion_keymap);
+    suggest_bind_newline(vi_movement_keymap);
   }
-  install_sigquit_handler();
-  ignore_sigpipe();
+  return 0;
 }
 
-static void kill_sqlplus()
+/*
+   Add the statement of history record `rec' at `map' to the readline
+   history list.
+   */
+static void hist_add_record(const char *map, struct hist_record *rec)
 {
-  kill(sqlplus_pid, SIGTERM);
+  char *text;
+
+  text = malloc(rec->text_len+1);
+  memcpy(text, map+sizeof(*rec)+rec->ident_len, rec->text_len);
+  text[rec->text_len] = '\0';
+  add_history(text);
+  suggest_add(text);
+  free(text);
 }
 
-//Return 1 if 'str' is one of the Oracle password prompts.
-static int check_password_prompt(char *str)
+/*
+   Open the history file and lock it exclusively. Retry if the file was
+   replaced (compacted) while we were waiting for the lock. Return the
+   locked descriptor; closing it releases the lock.
+   */
+static int lock_history_file(void)
 {
-  if (!str){
-    return 0;
+  int  fd;
+  struct flock fl;
+  struct stat fbuf;
+  struct stat pbuf;
+
+  for (;;)
+  {
+    fd = open(histname, O_RDWR | O_CREAT, 0600);
+    if (fd < 0)
+      return -1;
+    fl.l_type = F_WRLCK;
+    fl.l_whence = SEEK_SET;
+    fl.l_start = 0;
+    fl.l_len = 0;
+    while ((fcntl(fd, F_SETLKW, &fl) == -1) && (errno == EINTR))
+      ;
+    if (!fstat(fd, &fbuf) && !stat(histname, &pbuf) &&
+        (fbuf.st_ino == pbuf.st_ino) && (fbuf.st_dev == pbuf.st_dev))
+      return fd;
+    close(fd);
   }
-  int check_prompt = 0;
+}
 
-    if (!strcmp(str, PASSWORD_PROMPT) ||!strcmp(str, OLD_PASSWORD) ||!strcmp(str, NEW_PASSWORD) ||!strcmp(str, RETYPE_PASSWORD)){
-      check_prompt = 1;
+/*
+   Convert the plain-text history file `textname' of earlier gqlplus
+   versions into records appended to the locked history file `fd'.
+   */
+static void import_text_history(int fd, const char *textname)
+{
+  int    len;
+  int    rlen;
+  int    capacity;
+  int    blen;
+  char   *buffer;
+  char   *rbuf;
+  char   *line;
+  FILE   *fptr;
+  struct hist_record rec;
+
+  fptr = fopen(textname, "r");
+  if (!fptr)
+    return;
+  line = malloc((MAX_LINE_LENGTH+1)*sizeof(char));
+  capacity = MAX_LINE_LENGTH;
+  buffer = malloc(capacity);
+  blen = 0;
+  while (fgets(line, MAX_LINE_LENGTH, fptr))
+  {
+    len = strlen(line);
+    if (len && (line[len-1] == '\n'))
+      line[--len] = '\0';
+    if (!len)
+      continue;
+    /*
+       Imported statements have no metadata.
+       */
+    rbuf = hist_build_record(line, (char *) 0, 0, &rec);
+    rlen = rec.length;
+    while (blen+rlen > capacity)
+    {
+      capacity += capacity;
+      buffer = realloc(buffer, capacity);
     }
-  return check_prompt;
+    memcpy(buffer+blen, rbuf, rlen);
+    blen += rlen;
+    free(rbuf);
+  }
+  fclose(fptr);
+  if (blen)
+  {
+    write(fd, buffer, blen);
+    printf("gqlplus: imported history from %s\n", textname);
+  }
+  free(buffer);
+  free(line);
 }
 
 /*
-   Get sqlplus output from `fd' and display it (*outstr is NULL)
-   without prompt, or store it in *outstr. The prompt is returned and
-   will be displayed later, by readline() (if we display it here, it
-   would get overwritten by readline()).
+   Reap the child of compact_history_file() if it has finished. Called
+   at every prompt, as check_jobs() is, so it does not linger as a
+   zombie. Returns whether a compaction is still running.
    */
-static char *get_sqlplus(int fd, char *line, char **outstr)
+static int reap_compaction(void)
 {
-  int  done;
-  int  cntr;
-  int  nread = 0;
-  int  plen;
-  int  llen;
-  int  olen;
-  int  capacity;
-  int  ocapacity;
-  int  pdiff;
-  char *lline;
-  char *xtr;
-  char *last_line;
-  char *otr = (char *) 0;
-  char *ptr = (char *) 0;
-  char *prompt = (char *) 0;
+  if (compact_pid <= 0)
+    return 0;
+  if (waitpid(compact_pid, (int *) 0, WNOHANG) == 0)
+    return 1;
+  compact_pid = 0;
+  return 0;
+}
 
-  done = 0;
-  cntr = 0;
-  capacity = INIT_LINE_LENGTH;
-  ocapacity = INIT_LINE_LENGTH;
-     
-  //lline has the current undisplayed sqlplus content. llen is the length of the content.
-  
-  lline = malloc((capacity+1)*sizeof(char)); 
-  lline[0] = '\0';
-  llen = 0;
-  olen = 0;
-  if (outstr != (char **) 0)
+/*
+   Rewrite the history file with its last `histkeep' records. Runs in a
+   child process, so that the user never waits for it.
+   */
+static void compact_history_file(void)
+{
+  int   fd;
+  int   tfd;
+  off_t start;
+  char  *map;
+  char  *tmpname;
+  struct stat fbuf;
+
+  if (reap_compaction())
+    return; /* previous compaction still running */
+  compact_pid = fork();
+  if (compact_pid != 0)
+    return;
+  fd = lock_history_file();
+  if ((fd < 0) || fstat(fd, &fbuf) || (fbuf.st_size == 0))
+    _exit(0);
+  map = mmap((void *) 0, fbuf.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  if (map == MAP_FAILED)
+    _exit(0);
+  start = hist_tail(map, fbuf.st_size, histkeep);
+  tmpname = malloc(strlen(histname)+8);
+  sprintf(tmpname, "%s.XXXXXX", histname);
+  tfd = mkstemp(tmpname);
+  if (tfd >= 0)
   {
-    otr = malloc((ocapacity+1)*sizeof(char));
-    ptr = otr;
+    fchmod(tfd, 0600);
+    if ((write(tfd, map+start, fbuf.st_size-start) == fbuf.st_size-start) &&
+        !close(tfd))
+      rename(tmpname, histname);
+    else
+      unlink(tmpname);
   }
-  /*
-     Read sqlplus output. We read until sqlplus sends a prompt. We
-     recognize the following prompts:
+  _exit(0);
+}
 
-     'SQL> '
-     'Enter user-name: '
-     'Enter password: '
-     'Disconnected from Oracle...' 
-     'Enter value for ...' 
-     'Specify log: {<RET>=suggested | filename | AUTO | CANCEL}'
-     numeric prompt (for multi-line SQL statements)
-     user-defined prompt (see function set_sql_prompt())
+/*
+   Append statement `stmt', sent to sqlplus at time `start', to the
+   history file. With `pending', the record is written as soon as the
+   statement is entered, so that it survives whatever the statement
+   does to gqlplus, and its metadata is filled in by record_history()
+   once it completes. Otherwise the record is complete, with the rows,
+   bytes and error gathered from sqlplus output by scan_output().
+   */
+static void hist_append(const char *stmt, double start, int pending)
+{
+  int  fd;
+  char *rbuf;
+  struct stat fbuf;
+  struct hist_record rec;
 
-     So far looks like these are the only prompts. If sqlplus sends
-     anything else, we are doomed. ljb, 05/20/2002
-     */
-  while (done == 0)
+  if (histmax <= 0)
+    return;
+  fd = lock_history_file();
+  if (fd < 0)
+    return;
+  if (!fstat(fd, &fbuf))
   {
-    nread = read(fd, line, pipe_size);
-    if (nread > 0)
+    rbuf = hist_build_record(stmt, hist_ident, (time_t) start, &rec);
+    if (!pending)
     {
-      line[nread] = '\0';
-      fflush(stdout);
-      if (nread+llen > capacity)
+      rec.elapsed = (int32_t) ((now()-start)*1000.0);
+      rec.rows = out_rows;
+      rec.bytes = out_bytes;
+      rec.error = out_error;
+      memcpy(rbuf, &rec, sizeof(rec));
+    }
+    if (fbuf.st_ino != hist_inode)
+      hist_offset = -1; /* compacted by another session: reload on merge */
+    else if (fbuf.st_size != hist_offset)
+    {
+      if (hist_nown == hist_cown)
       {
-        while (nread+llen > capacity)
-          capacity += capacity;
-        lline = realloc(lline, capacity+1);
+        hist_cown = hist_cown ? 2*hist_cown : INIT_LENGTH;
+        hist_own = realloc(hist_own, hist_cown*sizeof(off_t));
       }
-      if ((outstr != (char **) 0) && (nread+olen > ocapacity))
+      hist_own[hist_nown++] = fbuf.st_size;
+    }
+    if (pwrite(fd, rbuf, rec.length, fbuf.st_size) == rec.length)
+    {
+      if (pending)
       {
-        while (nread+olen > ocapacity)
-          ocapacity += ocapacity;
-        pdiff = ptr-otr;
-        otr = realloc(otr, ocapacity+1);
-        ptr = otr+pdiff;
+        hist_pending = fbuf.st_size;
+        hist_pending_inode = fbuf.st_ino;
+        hist_pending_rec = rec;
       }
-      memcpy(&lline[llen], line, nread);
-      llen += nread;
-      lline[llen] = '\0';
-      if ((!strncmp(lline, QUIT_PROMPT_1, strlen(QUIT_PROMPT_1)) && (state == STARTUP)) || 
-          (strstr(lline, QUIT_PROMPT_1) && (state == STARTUP)) || 
-          strstr(lline, QUIT_PROMPT_2) || strstr(lline, USAGE_PROMPT))
+      if (fbuf.st_size == hist_offset)
+        hist_offset += rec.length;
+      if (fbuf.st_size+rec.length > hist_compact_size)
       {
-        done = 1;
-        quit_sqlplus = 1;
+        compact_history_file();
+        hist_compact_size = 2*(fbuf.st_size+rec.length);
       }
+    }
+    free(rbuf);
+  }
+  close(fd);
+}
 
-      /*
-         The following change is to address in ADE view gqlplus 
-         invocation problem.
-         */
-      if ((!strncmp(lline, VALUE_PROMPT, strlen(VALUE_PROMPT)))
-          || strstr(lline, SQL_PROMPT)
-          || strstr(lline, RECOVER_PROMPT)
-         ) 
-        done = 1;
+/*
+   Statement `stmt' has been entered: put it in the history file now.
+   */
+static void enter_history(const char *stmt, double start)
+{
+  hist_pending = -1;
+  hist_append(stmt, start, 1);
+}
 
-      /*
-         Display everything up to the last newline.
-         */
-      xtr = strrchr(lline, '\n');
-      if (xtr)
-      {
-        last_line = strdup(xtr+1);
-        plen = xtr-lline;
-        if (!outstr)
-        {
-          if (plen > 0)
-            write(STDOUT_FILENO, lline, plen);
-        }
-        else
-        {
-          memcpy(ptr, lline, plen);
-          ptr[plen] = '\0';
-          ptr += plen;
-          olen += plen;
-        }
-        /*
-           Adjust lline. After adjustment, only the last line
-           received from sqlplus, so far, remains in lline.
-           */
-        llen -= plen;
-        memcpy(lline, xtr, llen);
-        lline[llen] = '\0';
-        if ((sql_prompt && !strcmp(last_line, sql_prompt)) || 
-            !strcmp(last_line, USER_PROMPT) ||
-            !strncmp(last_line, VALUE_PROMPT, strlen(VALUE_PROMPT)) ||
-            check_time_prompt(last_line, sql_prompt) ||
-            check_password_prompt(last_line))
-          done = 1;
-        free(last_line);
-      }
-      else if ((sql_prompt && !strcmp(lline, sql_prompt)) || 
-          check_numeric_prompt(lline) ||
-          check_time_prompt(lline, sql_prompt) ||
-          check_password_prompt(lline))
-        done = 1;
-    }
-    else
-    {
-      if (nread < 0)
-        perror((char *) 0);
-    }
+/*
+   Add statement `stmt', sent to sqlplus at time `start', to the history
+   list, and store its elapsed time, rows, bytes and error in the record
+   enter_history() wrote. A statement that sqlplus made longer, at its
+   numeric prompt, is appended again in full.
+   */
+static void record_history(const char *stmt, double start)
+{
+  int  fd;
+  struct stat fbuf;
+
+  add_history(stmt);
+  suggest_add(stmt);
+  if (histmax <= 0)
+    return;
+  if ((hist_pending < 0) || (hist_pending_rec.text_len != strlen(stmt)))
+  {
+    hist_pending = -1;
+    hist_append(stmt, start, 0);
+    return;
   }
-  /*
-     Display the remaining content, up to the last newline. Everything
-     beyond that is the prompt.
-     */
-  xtr = strrchr(lline, '\n');
-  if (xtr)
+  fd = lock_history_file();
+  if (fd >= 0)
   {
-    xtr++;
-    prompt = strdup(xtr);
-    llen -= strlen(prompt);
-    if (!outstr)
-    {
-      if (llen > 0)
-        write(STDOUT_FILENO, lline, llen);
-    }
-    else 
+    if (!fstat(fd, &fbuf) && (fbuf.st_ino == hist_pending_inode))
     {
-      memcpy(ptr, lline, llen);
-      ptr[llen] = '\0';
+      hist_pending_rec.elapsed = (int32_t) ((now()-start)*1000.0);
+      hist_pending_rec.rows = out_rows;
+      hist_pending_rec.bytes = out_bytes;
+      hist_pending_rec.error = out_error;
+      pwrite(fd, &hist_pending_rec, sizeof(hist_pending_rec), hist_pending);
     }
-  }else{
-    prompt = strdup(lline);
-  }
-  free(lline);
-  if (outstr != (char **) 0){
-    *outstr = otr;
+    close(fd);
   }
-  /*install_sigint_handler();*/
-  return prompt;
+  hist_pending = -1;
 }
 
 /*
-   A special version of get_sqlplus() supporting the 'set sqlprompt'
-   command. This function is retrieving one line from sqlplus, and that
-   line is the new sql_prompt.
+   Pick up the statements written by other gqlplus sessions since we
+   last looked at the history file.
    */
-static char *set_sql_prompt(int fd, char *line)
+static void merge_history(void)
 {
-  int  cntr;
-  int  nread = 0;
-  int  llen;
-  char *lline;
-
-  cntr = 0;
-  /* 
-     lline has the current undisplayed sqlplus content. llen is the
-     length of the content.
-     */
-  lline = malloc((MAX_PROMPT_LEN+1)*sizeof(char)); 
-  lline[0] = '\0';
-  llen = 0;
-  /*
-     Get bytes from sqlplus. We gamble here that everything will come
-     from sqlplus in one read(), since 'set sqlprompt' is a simple and
-     quick operation. If it doesn't, we are doomed.
-     */
-  nread = read(fd, line, pipe_size);
-  if (nread > 0){
-    line[nread] = '\0';
-    fflush(stdout);
-    memcpy(&lline[llen], line, nread);
-    llen += nread;
-    lline[llen] = '\0';
-    cntr++;
-  }else{
-    if (nread < 0){
-      perror((char *) 0);
-      free(lline);
-      lline = (char *) 0;
+  int      fd;
+  int      merged;
+  int      reload;
+  int      own;
+  uint32_t len;
+  off_t    pos;
+  off_t    start;
+  char     *map;
+  struct stat fbuf;
+  struct hist_record rec;
+
+  fd = lock_history_file();
+  if (fd < 0)
+  {
+    perror(histname);
+    return;
+  }
+  merged = 0;
+  reload = 0;
+  if (!fstat(fd, &fbuf))
+  {
+    reload = (fbuf.st_ino != hist_inode) || (hist_offset < 0) || (fbuf.st_size < hist_offset);
+    if (reload)
+    {
+      clear_history();
+      hist_offset = 0;
+      hist_nown = 0;
     }
+    if ((fbuf.st_size > hist_offset) &&
+        ((map = mmap((void *) 0, fbuf.st_size, PROT_READ, MAP_SHARED, fd, 0)) != MAP_FAILED))
+    {
+      /*
+         On reload, only the last `histmax' records matter.
+         */
+      start = reload ? hist_tail(map, fbuf.st_size, histmax) : hist_offset;
+      own = 0;
+      for (pos = start; (len = hist_next_record(map, fbuf.st_size, &pos, &rec)); pos += len)
+      {
+        while ((own < hist_nown) && (hist_own[own] < pos))
+          own++;
+        if ((own < hist_nown) && (hist_own[own] == pos))
+          continue;
+        hist_add_record(map+pos, &rec);
+        merged++;
+      }
+      munmap(map, fbuf.st_size);
+    }
+    hist_offset = fbuf.st_size;
+    hist_inode = fbuf.st_ino;
+    hist_nown = 0;
   }
-  return lline;
+  close(fd);
+  using_history();
+  if (reload)
+    printf("gqlplus: history reloaded from %s\n", histname);
+  else
+    printf("gqlplus: %d history statement(s) merged from other sessions\n", merged);
 }
 
 /*
-   Single line read from sqlplus. 
+   Implement the `--!slow [hours] [count]' command: list the `count'
+   slowest statements of the last `hours' hours, across all sessions.
    */
-static char *read_sqlplus(int fd, char *line)
+static void slow_history(char *args)
 {
-  int  nread;
-  char *rline;
-
-  rline = (char *) 0;
-  /*
-  Get bytes from sqlplus. We gamble here that everything will come
-  from sqlplus in one read(). If it doesn't, we are doomed.
-   */
-  nread = read(fd, line, pipe_size);
-  if (nread > 0){
-    line[nread] = '\0';
-    rline = strdup(line);
-  }else if (nread < 0){
-    perror("read_sqlplus()");
+  int      fd;
+  int      i;
+  int      n;
+  int      count;
+  int      len;
+  uint32_t rlen;
+  off_t    pos;
+  time_t   since;
+  time_t   started;
+  char     *map;
+  char     *text;
+  char     stamp[32];
+  off_t    *top;
+  int32_t  *topms;
+  struct stat fbuf;
+  struct hist_record rec;
+
+  since = HIST_SLOW_HOURS;
+  count = HIST_SLOW_COUNT;
+  if (args)
+    args += strspn(args, WHITESPACE);
+  if (args && *args)
+  {
+    since = atoi(args);
+    args += strcspn(args, WHITESPACE);
+    args += strspn(args, WHITESPACE);
+    if (*args)
+      count = atoi(args);
   }
-  return rline;
+  if (count <= 0)
+    count = HIST_SLOW_COUNT;
+  since = time((time_t *) 0)-since*3600;
+  fd = open(histname, O_RDONLY);
+  if ((fd < 0) || fstat(fd, &fbuf) || (fbuf.st_size == 0) ||
+      ((map = mmap((void *) 0, fbuf.st_size, PROT_READ, MAP_SHARED, fd, 0)) == MAP_FAILED))
+  {
+    if (fd >= 0)
+      close(fd);
+    printf("No statement history.\n");
+    return;
+  }
+  top = malloc(count*sizeof(off_t));
+  topms = malloc(count*sizeof(int32_t));
+  n = 0;
+  for (pos = 0; (rlen = hist_next_record(map, fbuf.st_size, &pos, &rec)); pos += rlen)
+  {
+    if ((rec.start < since) || (rec.elapsed < 0) || ((n == count) && (rec.elapsed <= topms[n-1])))
+      continue;
+    i = (n < count) ? n++ : n-1;
+    for (; (i > 0) && (topms[i-1] < rec.elapsed); i--)
+    {
+      top[i] = top[i-1];
+      topms[i] = topms[i-1];
+    }
+    top[i] = pos;
+    topms[i] = rec.elapsed;
+  }
+  printf("%-19s %10s %10s %12s %9s  %s\n", "STARTED", "ELAPSED", "ROWS", "BYTES", "ERROR", "STATEMENT");
+  for (i = 0; i < n; i++)
+  {
+    memcpy(&rec, map+top[i], sizeof(rec));
+    started = (time_t) rec.start;
+    strftime(stamp, sizeof(stamp), "%Y-%m-%d %H:%M:%S", localtime(&started));
+    text = map+top[i]+sizeof(rec)+rec.ident_len;
+    len = strcspn(text, "\n");
+    if (len > (int) rec.text_len)
+      len = rec.text_len;
+    printf("%-19s %9.2fs %10lld %12lld ", stamp, rec.elapsed/1000.0, (long long) rec.rows, (long long) rec.bytes);
+    if (rec.error)
+      printf("ORA-%05d", rec.error);
+    else
+      printf("%9s", "");
+    printf("  %.*s%s", len > 60 ? 60 : len, text, (len > 60 || len < (int) rec.text_len) ? "..." : "");
+    if (rec.ident_len)
+      printf(" [%.*s]", (int) rec.ident_len, map+top[i]+sizeof(rec));
+    printf("\n");
+  }
+  free(top);
+  free(topms);
+  munmap(map, fbuf.st_size);
+  close(fd);
 }
 
-/*
-   Special processing for the ACCEPT sqplus command `cmd'. The special
-   processing is required because the command essentially redefines
-   prompt while the user enters value of the variable defined in the
-   ACCEPT command, thus we cannot use the standard gqlplus loop to read
-   message from sqlplus.
-   */
-static char *accept_cmd(char *cmd, int fdin, int fdout, char *sql_prompt, char *line)
+void save_history(void)
 {
-  int  status;
-  int  len;
-  char *accept;
-  char *rline;
-  char *prompt;
-  char *ptr;
-  char *fline;
+  struct stat fbuf;
 
-  accept = (char *) 0;
-  /*
-     Is there a prompt? If there is, read sqlplus message (which will
-     be either the ACCEPT prompt, or an error message).
-     */
-  if (strstr(cmd, " prompt "))
-  {
-    /* 
-       Ensure that entire sqlplus message will arrive in a single
-       read(). This is particularly important in case of error
-       messages, which seem to arrive in two pieces.
-       */
-    sleep(1);
-    /*
-       Read the sqlplus message in response to the ACCEPT
-       command. Typically, that would be `prompt' parameter of the ACCEPT
-       command.
-       */
-    accept = read_sqlplus(fdin, line);
-  }
   /*
-     If this message is terminated with `sql_prompt', that means that
-     sqlplus actually returned error message. If that is the case,
-     print the first line, and return.
+     Everything has already been appended to the history file by
+     record_history().
      */
-  if (accept && (ptr = strchr(accept, '\n'))){
-    len = ptr-accept+1;
-    fline = malloc((len+1)*sizeof(char));
-    memcpy(fline, accept, len);
-    fline[len] = '\0';
-    printf("%s", fline);
-    fflush(stdout);
-    free(fline);
-    prompt = strdup(sql_prompt);
-  }else{
-    /*
-       Now place user input in `rline' using readline().
-       */
-    rline = readline(accept);
-    /*
-       Send it to sqlplus.
-       */
-    write(fdout, rline, strlen(rline));
-    /*
-       Terminate the user input sent to sqlplus.
-       */
-    status = write(fdout, "\n", 1);
-    if (status == -1){
-      fprintf(stderr, "sqlplus terminated - exiting...\n");
-      exit(-1);
-    }
-    /*
-       Now read the message sent from sqlplus, which should be the SQL
-       prompt. We don't display it, since that will be done by the
-       subsequent readline() call.
-       */
-    prompt = read_sqlplus(fdin, line);
-  }
-  return prompt;
+  if (!stat(histname, &fbuf) && (fbuf.st_size == 0))
+    /* If history is of length 0 (because set as is or slave is not executable) */
+    unlink(histname);
+  else if (history_list() != NULL)
+    printf("\nSession history saved to: %s\n", histname);
 }
 
-/*
-   Extract tokens (separated by characters in 'delimiter' string) from
-   'str'. Return NULL-terminated array of tokens.
+void initialize_history(char *appl_name)
+{
+  int      fd;
+  uint32_t len;
+  off_t    pos;
+  off_t    end;
+  char     *map;
+  char     *textname;
+  char     buffer[MAXPATHLEN];
+  struct stat fbuf;
+  struct hist_record rec;
 
-   The function allocates the space for the returned array. It is the
-   caller's responsibility to free it.
+  /* Find the real name of the history file using the tilde_expand function 
+   * which is in the readline library.
    */
-static char **str_tokenize(char *str, char *delimiter)
-{
-  int  len;
-  int  i;
-  int  rlen;
-  int  cntr;
-  int  capacity = INIT_LENGTH;
-  char *xtr;
-  char *ptr;
-  char **tokens;
-  char **xtokens;
+  sprintf(buffer, "~/.%s_history", appl_name);
+  textname = tilde_expand(buffer);
+  sprintf(buffer, "~/.%s_history.db", appl_name);
+  histname = tilde_expand(buffer);
 
-  tokens = (char **) 0;
-  cntr = 0;
-  if ((str != (char *) 0) && (delimiter != (char *) 0))
-  {
-    rlen = strlen(str);
-    if (rlen > 0)
-    {
-      tokens = malloc(INIT_LENGTH*sizeof(char *));
-      capacity = INIT_LENGTH;
-    }
-    xtr = str;
-    while (rlen > 0)
+  using_history();  
+  if (histmax >= 0) {
+    stifle_history(histmax);
+    atexit(save_history);
+    fd = lock_history_file();
+    if ((fd >= 0) && !fstat(fd, &fbuf))
     {
-      len = strspn(xtr, delimiter);
-      xtr += len;
-      rlen -= len;
-      len = strcspn(xtr, delimiter);
-      rlen -= len;
-      if (len > 0)
+      if (fbuf.st_size == 0)
       {
-        ptr = malloc(len+1);
-        memcpy(ptr, xtr, len);
-        ptr[len] = '\0';
-        xtr += len;
-        tokens[cntr++] = ptr;
-        if (cntr >= capacity)
+        import_text_history(fd, textname);
+        fstat(fd, &fbuf);
+      }
+      /*
+         Load the last `histmax' statements, walking back from the end
+         of the file. A gqlplus killed while writing a record leaves it
+         torn at the end; it is cut off first.
+         */
+      if ((fbuf.st_size > 0) &&
+          ((map = mmap((void *) 0, fbuf.st_size, PROT_READ, MAP_SHARED, fd, 0)) != MAP_FAILED))
+      {
+        for (end = fbuf.st_size; (end > 0) && (hist_prev_record(map, end) < 0); end--)
+          ;
+        for (pos = hist_tail(map, end, histmax); (len = hist_next_record(map, end, &pos, &rec)); pos += len)
+          hist_add_record(map+pos, &rec);
+        munmap(map, fbuf.st_size);
+        if ((end < fbuf.st_size) && !ftruncate(fd, end))
         {
-          capacity += capacity;
-          xtokens = malloc(capacity*sizeof(char *));
-          for (i = 0; i < cntr; i++)
-          {
-            xtokens[i] = strdup(tokens[i]);
-            free(tokens[i]);
-          }
-          free(tokens);
-          tokens = xtokens;
+          fprintf(stderr, "gqlplus: removed a torn record from the end of %s\n", histname);
+          fbuf.st_size = end;
         }
       }
+      hist_offset = fbuf.st_size;
+      hist_inode = fbuf.st_ino;
+      hist_compact_size = 2*fbuf.st_size;
+      if (hist_compact_size < HIST_COMPACT_MIN)
+        hist_compact_size = HIST_COMPACT_MIN;
+      close(fd);
     }
-    if (tokens)
-      tokens[cntr] = (char *) 0;
+  } else {
+    max_input_history = -histmax;
   }
-  return tokens;
-}
-
-static void str_free(char **tokens)
-{
-  int i;
-
-  i = 0;
-  if (tokens)
-    while (tokens[i] != (char *) 0)
-      free(tokens[i++]);
-  free(tokens);
+  free(textname);
 }
 
-static char *sfree(char *str)
+/*
+   Set 'str' to lowercase.
+   */
+static void tl2(char *str)
 {
-  free(str);
-  return (char *) 0;
+  if (!str){
+    return;
+  }
+  int  i = 0;
+  while (str[i] != '\0'){
+    str[i] = tolower((int) str[i]);
+    i++;
+  }
 }
 
 /*
-   Return 1 if file described by `st_mode' is regular executable file.
+   Return the lowercase version of 'str', without leading and trailing
+   blanks. The buffer is reused by every call: for the line the user
+   enters, the statement --!capture records and the word being
+   completed, which never overlap.
    */
-static int check_mode(mode_t st_mode)
+static char *lower_line(const char *str)
 {
-  int mode;
-  mode_t mode1;
-  mode_t mode2;
+  static char *buffer = (char *) 0;
+  static int  capacity = 0;
+  int  len;
+  int  i;
 
-  mode = 0;
-  mode1 = S_ISREG(st_mode);
-  if (mode1)
+  str += strspn(str, " ");
+  len = strlen(str);
+  while ((len > 0) && (str[len-1] == ' '))
+    len--;
+  if (len >= capacity)
   {
-    mode2 = S_IXUSR;
-    mode = st_mode & S_IXUSR;
+    capacity = (len < INIT_LINE_LENGTH) ? INIT_LINE_LENGTH : 2*len;
+    buffer = realloc(buffer, (capacity+1)*sizeof(char));
   }
-  return mode;
+  for (i = 0; i < len; i++)
+    buffer[i] = tolower((int) str[i]);
+  buffer[len] = '\0';
+  return buffer;
 }
 
 /*
-   Search PATH for executable `exe'. Return full path to exe.
+   Commands that gqlplus carries out itself, or watches on their way to
+   sqlplus. A line is taken for a command if it starts with the first
+   `abbrev' characters of `keyword'; an `exact' command must also make
+   up the whole line. Commands of gqlplus itself follow szCmdPrefix.
    */
-static char *search_path(char *exe)
+enum command_id
 {
-  int  i;
-  int  status;
-  int  done;
-  int  mode;
-  char *path;
-  char *env;
-  char *str;
-  char *xtr;
-  char **dirs;
-  struct stat buf;
+  CMD_NONE,
+  CMD_SET,
+  CMD_PAUSE,
+  CMD_SELECT,
+  CMD_CONNECT,
+  CMD_DISCONNECT,
+  CMD_QUIT,
+  CMD_ACCEPT,
+  CMD_EDIT,
+  CMD_CLEAR,
+  CMD_REBUILD,
+  CMD_HISTORY,
+  CMD_MERGE,
+  CMD_SLOW,
+  CMD_TIMEOUT,
+  CMD_LIMIT,
+  CMD_MORE,
+  CMD_WARN,
+  CMD_NEW,
+  CMD_SWITCH,
+  CMD_LIST,
+  CMD_BG,
+  CMD_JOBS,
+  CMD_EXPORT,
+  CMD_CAPTURE,
+  CMD_WATCH
+};
 
-  path = (char *) 0;
-  env = getenv(PATH);
-  if (env)
+struct command
+{
+  const char      *keyword;
+  int             abbrev;
+  int             exact;
+  enum command_id id;
+};
+
+static const struct command sqlplus_commands[] =
+{
+  { SET_CMD,        3, 0, CMD_SET },
+  { PAUSE_CMD,      3, 0, CMD_PAUSE },
+  { SELECT_CMD,     6, 0, CMD_SELECT },
+  { CONNECT_CMD,    4, 0, CMD_CONNECT },
+  { DISCONNECT_CMD, 4, 0, CMD_DISCONNECT },
+  { QUIT_CMD,       4, 1, CMD_QUIT },
+  { EXIT_CMD,       4, 1, CMD_QUIT },
+  { ACCEPT_CMD,     3, 0, CMD_ACCEPT },
+  { EDIT_CMD,       2, 0, CMD_EDIT },
+  { CLEAR_CMD,      2, 0, CMD_CLEAR },
+  { (char *) 0,     0, 0, CMD_NONE }
+};
+
+static const struct command gqlplus_commands[] =
+{
+  { "rebuild",      1, 0, CMD_REBUILD },
+  { "history",      1, 0, CMD_HISTORY },
+  { "merge",        5, 0, CMD_MERGE },
+  { "slow",         4, 0, CMD_SLOW },
+  { "timeout",      7, 0, CMD_TIMEOUT },
+  { "limit",        5, 0, CMD_LIMIT },
+  { "more",         4, 0, CMD_MORE },
+  { "warn",         4, 0, CMD_WARN },
+  { "new",          3, 0, CMD_NEW },
+  { "switch",       6, 0, CMD_SWITCH },
+  { "list",         4, 1, CMD_LIST },
+  { "bg",           2, 0, CMD_BG },
+  { "jobs",         4, 1, CMD_JOBS },
+  { "export",       6, 0, CMD_EXPORT },
+  { "capture",      7, 0, CMD_CAPTURE },
+  { "watch",        5, 0, CMD_WATCH },
+  { (char *) 0,     0, 0, CMD_NONE }
+};
+
+/*
+   Classify the lowercase line `lline' in a single pass, without
+   copying it. `args' is set to the first word after the command, or
+   to null if there is none.
+   */
+static enum command_id classify_command(const char *lline, const char **args)
+{
+  const struct command *table;
+  const struct command *cmd;
+  const char *ptr;
+  int  len;
+
+  *args = (char *) 0;
+  lline += strspn(lline, WHITESPACE);
+  table = sqlplus_commands;
+  len = strlen(szCmdPrefix);
+  if (!strncmp(lline, szCmdPrefix, len))
   {
-    dirs = str_tokenize(env, ":");
-    i = 0;
-    str = malloc(strlen(env)+strlen(exe)+2);
-    done = 0;
-    while (((xtr = dirs[i++]) != (char *) 0) && !done)
+    table = gqlplus_commands;
+    lline += len;
+    lline += strspn(lline, WHITESPACE);
+  }
+  for (cmd = table; cmd->keyword; cmd++)
+  {
+    if (strncmp(lline, cmd->keyword, cmd->abbrev))
+      continue;
+    ptr = lline+strcspn(lline, WHITESPACE);
+    ptr += strspn(ptr, WHITESPACE);
+    if (cmd->exact)
     {
-      sprintf(str, "%s/%s", xtr, exe);
-      status = stat(str, &buf);
-      if (!status)
-      {
-        mode = check_mode(buf.st_mode);
-        if (mode)
-        {
-          path = str;
-          done = 1;
-        }
-      }
+      len = strlen(cmd->keyword);
+      if (strncmp(lline, cmd->keyword, len) || (lline[len+strspn(lline+len, WHITESPACE)] != '\0'))
+        continue;
     }
-    str_free(dirs);
+    if (*ptr)
+      *args = ptr;
+    return cmd->id;
   }
-  return path;
+  return CMD_NONE;
 }
 
 /*
-   Search PATH for file named `exe' with proper permissions. Return
-   full path to the file.
+   Utility function for check_numeric_prompt().
    */
-static char *search_exe(char *exe)
+
+static int check_numeric(const char *str)
 {
-  int  status;
-  int  mode;
-  char *path;
-  char *lpath;
-  struct stat buf;
+  int check_prompt = 0;
 
-  path = (char *) 0;
-  lpath = search_path(exe);
-  if (lpath)
-  {
+  if (strlen(str) == 5)
+    if (isspace((int) str[4]))
+      if (isspace((int) str[3]) || (str[3] == '*') || (str[3] == 'i'))
+        if (isdigit((int) str[2]))
+        {
+          check_prompt = 1;
+          if (isdigit((int) str[0]) && isspace((int) str[1]))
+            check_prompt = 0;
+        }
+  return check_prompt;
+}
+
+/*
+   Return 1 if 'str' is a correct Oracle numeric prompt. The numeric
+   prompt has up to three numeric characters, followed by a space, or
+   an asterisk, or an 'i' (for Insert command).
+
+   ljb, 06/16/2004: there is another version of a numeric prompt, when
+   'time' is set. The prompt looks like this:
+
+   SQL> set time on
+19:41:37 SQL> select * from scott.salgrade
+19:41:42   2  ;
+*/
+static int check_numeric_prompt(const char *str)
+{
+  if (!str){
+     return 0;
+  }
+  int check_prompt = 0;
     /*
-       Check permissions.
+       Check for the short version of the numeric prompt:
        */
-    status = stat(lpath, &buf);
-    if (!status) 
-    {
-      mode = check_mode(buf.st_mode);
-      if (mode)
-        path = lpath;
+    if (strlen(str) == 5){
+      check_prompt = check_numeric(str);
+    /*
+       Check for the long version of the numeric prompt (when time is set):
+       */
+    }else if (strlen(str) == 14){
+      if (isdigit((int) str[0]) && isdigit((int) str[1]) &&
+          str[2] == ':' && isdigit((int) str[3]) && isdigit((int) str[4]) &&
+          str[5] == ':' && isdigit((int) str[6]) && isdigit((int) str[7]) &&
+          isspace((int) str[8]))
+        check_prompt = check_numeric(str+9);
     }
+    return check_prompt;
+}
+
+/*
+   Return 1 if 'str' is a correct Oracle time prompt. The time prompt
+   has time followed by a space followed by `sqlprompt', like this:
+
+19:41:37 SQL>
+*/
+static int check_time_prompt(char *str, char *sqlprompt)
+{
+  if (!str){
+    return 0;
   }
-  return path;
+  int check_prompt = 0;
+  if (isdigit((int) str[0]) && isdigit((int) str[1]) &&
+      str[2] == ':' && isdigit((int) str[3]) && isdigit((int) str[4]) &&
+      str[5] == ':' && isdigit((int) str[6]) && isdigit((int) str[7]) &&
+      isspace((int) str[8]) && !strcmp(&str[9], sqlprompt)){
+        check_prompt = 1;
+  }
+  return check_prompt;
 }
 
-char *get_env(char *name)
+/*
+   Return the length of the numeric prompt at the start of `str', or 0
+   if `str' doesn't start with one.
+   */
+static int numeric_prompt_len(const char *str)
 {
-  char *xtr;
-  char *env;
+  int  len;
+  int  slen;
+  char buffer[15];
 
-  xtr = getenv(name);
-  if (xtr != (char *) 0)
+  slen = strlen(str);
+  for (len = 5; len <= 14; len += 9)
+    if (slen >= len)
+    {
+      memcpy(buffer, str, len);
+      buffer[len] = '\0';
+      if (check_numeric_prompt(buffer))
+        return len;
+    }
+  return 0;
+}
+
+void ignore_sigint()
+{
+  sigemptyset(&iact.sa_mask);
+  iact.sa_flags = 0;
+#ifdef SA_RESTART
+  iact.sa_flags |= SA_RESTART;
+#endif
+  iact.sa_handler = SIG_IGN;
+  sigaction(SIGINT, &iact, (struct sigaction *) 0);
+}
+
+static void ignore_sigpipe()
+{
+  sigemptyset(&pact.sa_mask);
+  pact.sa_flags = 0;
+#ifdef SA_RESTART
+  pact.sa_flags |= SA_RESTART;
+#endif
+  pact.sa_handler = SIG_IGN;
+  sigaction(SIGPIPE, &pact, (struct sigaction *) 0);
+}
+
+/*
+   SIGINT handler. Passes the signal to the child (i.e., sqlplus)
+   unless we are in the middle of an editing session (edit_pid !=
+   0). The reason is this: Emacs redefines Ctrl-G to be
+   SIGINT-generating key (instead of Ctrl-C). So, during Emacs editing
+   session, Ctrl-G generates SIGINT which we don't want to pass to
+   sqlplus because it disrupts its' operation and does not make sense
+   anyway (that is not the interrupt we want to catch; we only care
+   about Ctrl-C typed at gqlplus prompt).
+   */
+static void sigint_handler(int signo)
+{
+  interrupts++;
+  if ((edit_pid == 0) && sqlplus_busy)
   {
-    env = malloc(strlen(name)+strlen(xtr)+2);
-    sprintf(env, "%s=%s", name, xtr);
+    if (sqlplus_pid > 0)
+      kill(sqlplus_pid, SIGINT);
+    cancel_requested = 1;
+    tcflush(STDOUT_FILENO, TCOFLUSH);
+    //ignore_sigint();
   }
-  else
-    env = strdup("");
-  return env;
 }
 
-char **get_environment(void)
+   //SIGQUIT handler.
+static void sigquit_handler(int signo)
 {
-  int  idx;
-  char *env;
-  char **enx;
+  kill(sqlplus_pid, signo);
+  printf("Quit\n");
+  _exit(0);
+}
 
-  enx = calloc(MAX_NENV+1, sizeof(char *));
-  env = get_env(ORACLE_HOME);
-  idx = 0;
-  enx[idx++] = env;
-  enx[idx++] = get_env(ORACLE_SID);
-  enx[idx++] = get_env(TNS_ADMIN);
-  enx[idx++] = get_env(SQLPATH);
-  enx[idx++] = get_env(NLS_LANG); /* added by dbakorea */
-  enx[idx++] = get_env(ORA_NLS33); /* added by dbakorea */
-  enx[idx++] = get_env(NLS_DATE_FORMAT); /* added by leeym */
-  enx[idx++] = get_env(NLS_COMP); 
-  enx[idx++] = get_env(NLS_SORT); 
-  enx[idx++] = get_env(LD_LIBRARY_PATH); 
-  enx[idx++] = get_env(DYLD_LIBRARY_PATH); 
-  enx[idx++] = get_env(ORACLE_PATH);
-  enx[idx++] = get_env(TWO_TASK); 
-  return enx;
+void install_sigint_handler()
+{
+  sigemptyset(&iact.sa_mask);
+  iact.sa_flags = 0;
+#ifdef SA_RESTART
+  iact.sa_flags |= SA_RESTART;
+#endif
+     //Use sigaction(), for portability and reliability.
+  iact.sa_handler = sigint_handler;
+  sigaction(SIGINT, &iact, (struct sigaction *) 0);
 }
 
-static void print_environment(char **enx)
+void install_sigquit_handler()
 {
-  int  idx;
-  char *env;
+  sigemptyset(&qact.sa_mask);
+  qact.sa_flags = 0;
+#ifdef SA_RESTART
+  qact.sa_flags |= SA_RESTART;
+#endif
+     //Use sigaction(), for portability and reliability.
+  qact.sa_handler = sigquit_handler;
+  sigaction(SIGQUIT, &qact, (struct sigaction *) 0);
+}
 
-  idx = 0;
-  while (enx[idx])
-    printf("enx[%d]: '%s'\n", idx, enx[idx++]);
+/*
+   SIGALRM handler. The statement has run longer than --!timeout
+   allows; interrupt it just as Ctrl-C would.
+   */
+static void sigalrm_handler(int signo)
+{
+  (void) signo;
+  if (sqlplus_busy)
+  {
+    if (sqlplus_pid > 0)
+      kill(sqlplus_pid, SIGINT);
+    cancel_requested = 1;
+    timed_out = 1;
+  }
+}
+
+void install_sigalrm_handler()
+{
+  sigemptyset(&aact.sa_mask);
+  aact.sa_flags = 0;
+#ifdef SA_RESTART
+  aact.sa_flags |= SA_RESTART;
+#endif
+  aact.sa_handler = sigalrm_handler;
+  sigaction(SIGALRM, &aact, (struct sigaction *) 0);
 }
 
 /*
-   Find the location of `sqlplus' binary. `orahome' is the value of
-   ORACLE_HOME environment variable, if it is defined.
+   Start the statement timer, if there is a timeout, or stop it.
+   */
+static void arm_timeout(int on)
+{
+  struct itimerval it;
 
-   The rules are as follows:
+  memset(&it, 0, sizeof(it));
+  if (on)
+  {
+    if (statement_timeout <= 0)
+      return;
+    it.it_value.tv_sec = statement_timeout;
+    timeout_armed = now();
+  }
+  setitimer(ITIMER_REAL, &it, (struct itimerval *) 0);
+}
 
-   - look for executable binary `sqlplus' in PATH
-   - if not found, look for executable binary `sqlplus' in
-   ORACLE_HOME/bin
-   - if not found, look for executable binary `sqlplus' in the current
-   directory
+/*
+   The --!timeout command: show or set the statement timeout.
+   */
+static void set_timeout(char *args)
+{
+  if (args)
+    args += strspn(args, WHITESPACE);
+  if (args && *args)
+  {
+    if (!strncmp(args, "off", 3))
+      statement_timeout = 0;
+    else if (isdigit((int) *args))
+      statement_timeout = atoi(args);
+    else
+    {
+      printf("Usage: %stimeout [seconds|off]\n", szCmdPrefix);
+      return;
+    }
+  }
+  if (statement_timeout > 0)
+    printf("Statement timeout is %d seconds.\n", statement_timeout);
+  else
+    printf("No statement timeout.\n");
+}
 
-   Return full path of the binary. Return NULL if it doesn't exist or
-   isn't executable.
+/*
+   The --!limit command: show or set the number of rows and bytes a
+   query may display before it is cancelled.
    */
-static char *stat_sqlplus(const char *orahome)
+static void set_limit(char *args)
 {
-  int status = 0;
-  int mode;
-  char *spath;
-  struct stat buf;
+  char *ptr;
+
+  if (args)
+    args += strspn(args, WHITESPACE);
+  if (args && *args)
+  {
+    if (!strncmp(args, "off", 3))
+      row_limit = byte_limit = 0;
+    else if (isdigit((int) *args))
+    {
+      row_limit = strtoll(args, &ptr, 10);
+      ptr += strspn(ptr, WHITESPACE);
+      byte_limit = isdigit((int) *ptr) ? strtoll(ptr, (char **) 0, 10) : 0;
+    }
+    else
+    {
+      printf("Usage: %slimit [rows [bytes]|off]\n", szCmdPrefix);
+      return;
+    }
+  }
+  if (row_limit > 0)
+    printf("Queries stop after %lld rows", row_limit);
+  else
+    printf("No row limit");
+  if (byte_limit > 0)
+    printf(" or %lld bytes of output.\n", byte_limit);
+  else
+    printf(".\n");
+}
 
+/*
+   A query `stmt' is about to be sent to sqlplus; apply the output
+   limits to it. `fresh' is 0 when it is the continuation of the query
+   that last hit a limit.
+   */
+static void arm_limit(char *stmt, int fresh)
+{
+  int len;
+
+  shown_rows = 0;
+  shown_bytes = 0;
+  in_rows = 0;
+  line_kind = 0;
+  limit_hit = 0;
+  limit_armed = (row_limit > 0) || (byte_limit > 0);
+  if (!limit_armed || !fresh)
+    return;
   /*
-     Check PATH for sqlplus binary.
+     Keep the query without its terminator, ready for an OFFSET
+     clause.
      */
-  spath = getenv("SQLPLUS_BIN");
-  if (!spath){
-    spath = search_exe("sqlplus");
-    if (orahome){
-      /*
-         Not found, check $ORACLE_HOME/bin.
-         */
-      spath = malloc(strlen(orahome)+30);
-      sprintf(spath, "%s/bin/sqlplus", orahome);
-      status = stat(spath, &buf);
-      if (!status) {
-        mode = check_mode(buf.st_mode);
-        if (!mode){
-          spath = sfree(spath);
-        }
-      }else{
-        spath = sfree(spath);
-      }
-    }
-    if (!spath){
-      /*
-         Check the current directory.
+  free(limit_stmt);
+  limit_stmt = strdup(stmt);
+  limit_offset = 0;
+  len = strlen(limit_stmt);
+  while ((len > 0) && (isspace((int) limit_stmt[len-1]) || (limit_stmt[len-1] == ';')))
+    len--;
+  if ((len > 0) && (limit_stmt[len-1] == '/') && ((len == 1) || (limit_stmt[len-2] == '\n')))
+    len--;
+  limit_stmt[len] = '\0';
+}
+
+/*
+   The query is over. Unless it was stopped by a limit, there is
+   nothing for --!more to fetch.
+   */
+static void end_limit(void)
+{
+  if (limit_armed)
+  {
+    free(limit_stmt);
+    limit_stmt = (char *) 0;
+  }
+  limit_armed = 0;
+  limit_hit = 0;
+}
+
+/*
+   The --!more command: replace `rline' with the query that last hit a
+   limit, paged past the rows already shown.
+   */
+static char *more_statement(char *rline)
+{
+  char *more;
+
+  if (!limit_stmt)
+  {
+    printf("Nothing more to fetch.\n");
+    return rline;
+  }
+  more = malloc(strlen(limit_stmt)+120);
+  /*
+     The query goes in an inline view, since it may have an OFFSET or
+     FETCH clause of its own, or end in a comment. One row more than
+     the limit, so that running into the limit again tells us there is
+     still more to come.
+     */
+  if (row_limit > 0)
+    sprintf(more, "select * from (\n%s\n) offset %lld rows fetch next %lld rows only;",
+        limit_stmt, limit_offset, row_limit+1);
+  else
+    sprintf(more, "select * from (\n%s\n) offset %lld rows;", limit_stmt, limit_offset);
+  free(rline);
+  return more;
+}
+
+// Install signal handlers.
+void sig_init(void)
+{
+  if (getenv("EMACS_MODE"))
+    printf("Operating in Emacs mode.\nUnset EMACS_MODE if this is not desired.\n");
+  install_sigint_handler();
+  install_sigquit_handler();
+  install_sigalrm_handler();
+  ignore_sigpipe();
+}
+
+static void kill_sqlplus()
+{
+  sqlplus_killed = 1;
+  kill(sqlplus_pid, SIGTERM);
+}
+
+//Return 1 if 'str' is one of the Oracle password prompts.
+static int check_password_prompt(char *str)
+{
+  if (!str){
+    return 0;
+  }
+  int check_prompt = 0;
+
+    if (!strcmp(str, PASSWORD_PROMPT) ||!strcmp(str, OLD_PASSWORD) ||!strcmp(str, NEW_PASSWORD) ||!strcmp(str, RETYPE_PASSWORD)){
+      check_prompt = 1;
+    }
+  return check_prompt;
+}
+
+/*
+   Gather statistics of the current statement from `len' bytes of
+   complete sqlplus output lines in `str': the row count sqlplus
+   reports ("12 rows selected.", "1 row updated.") and the first ORA-
+   error.
+   */
+static void scan_output(const char *str, int len)
+{
+  const char *end;
+  const char *eol;
+  const char *xtr;
+
+  end = str+len;
+  for (; str < end; str = eol+1)
+  {
+    eol = memchr(str, '\n', end-str);
+    if (!eol)
+      eol = end;
+    xtr = str;
+    while ((xtr < eol) && isspace((int) *xtr))
+      xtr++;
+    if ((xtr < eol) && isdigit((int) *xtr))
+    {
+      len = strspn(xtr, DIGITS);
+      if ((eol-xtr > len+4) && !strncmp(xtr+len, " row", 4))
+        out_rows = atoll(xtr);
+    }
+    else if ((eol-xtr >= 16) && !strncmp(xtr, "no rows selected", 16))
+      out_rows = 0;
+    if (!out_error && (eol-str >= 9))
+      for (xtr = str; xtr+9 <= eol; xtr++)
+        if ((*xtr == 'O') && !strncmp(xtr, "ORA-", 4) && isdigit((int) xtr[4]))
+        {
+          out_error = atoi(xtr+4);
+          break;
+        }
+  }
+}
+
+/*
+   A --!watch run, see watch_statement(). Its output goes to
+   watch_output() as it streams in, instead of to the screen; one hash
+   is kept per screen line, and the start of the line being read.
+   */
+struct watcher
+{
+  int      rows;               /* result lines that fit on the screen */
+  int      cols;
+  int      n;                  /* lines of this run so far */
+  int      nprev;              /* lines drawn by the run before, -1 on the first */
+  int      len;                /* bytes of the current line */
+  uint32_t h;                  /* its FNV-1a hash */
+  char     *text;              /* its first `cols' bytes */
+  uint32_t *hashes;
+  char     *hilite;
+};
+
+  static struct watcher *watching = (struct watcher *) 0;
+
+/*
+   Draw line `n' of a --!watch result, `len' bytes of `str',
+   highlighted if `hilite'.
+   */
+static void watch_line(int n, const char *str, int len, int hilite)
+{
+  printf("\033[%d;1H%s%.*s%s\033[K", n+WATCH_TOP, hilite ? "\033[7m" : "",
+      len, str, hilite ? "\033[0m" : "");
+}
+
+/*
+   The current line of `w' is complete: redraw it if it is new or has
+   changed, or to take the highlight off.
+   */
+static void watch_end_line(struct watcher *w)
+{
+  int changed;
+
+  if (w->n < w->rows)
+  {
+    changed = (w->n >= w->nprev) || (w->h != w->hashes[w->n]);
+    if (changed || w->hilite[w->n])
+    {
+      w->hilite[w->n] = (w->nprev >= 0) && changed;
+      watch_line(w->n, w->text, (w->len < w->cols) ? w->len : w->cols, w->hilite[w->n]);
+    }
+    w->hashes[w->n] = w->h;
+  }
+  w->n++;
+  w->len = 0;
+  w->h = FNV_BASIS;
+}
+
+static void watch_output(struct watcher *w, const char *str, int len)
+{
+  for (; len > 0; str++, len--)
+  {
+    if (*str == '\n')
+      watch_end_line(w);
+    else
+    {
+      if (w->len < w->cols)
+        w->text[w->len] = *str;
+      w->len++;
+      w->h = (w->h^(unsigned char) *str)*FNV_PRIME;
+    }
+  }
+}
+
+/*
+   Display `len' bytes of sqlplus output. Once the user has cancelled
+   the statement, whatever sqlplus had already queued up is counted
+   instead, so that the prompt comes back without the flood.
+
+   A query subject to the output limits has its rows counted as they
+   go by: the non-blank lines between the dashes under the column
+   headings and the blank line that ends a page. When it reaches a
+   limit it is cancelled the same way.
+   */
+static void show_output(const char *str, int len)
+{
+  const char *eol;
+  const char *end;
+
+  if (watching)
+  {
+    watch_output(watching, str, len);
+    return;
+  }
+  end = str+len;
+  if (!cancel_requested && limit_armed)
+  {
+    for (eol = str; eol < end; eol++)
+    {
+      if (*eol == '-')
+        line_kind |= 1;
+      else if ((*eol != '\n') && !isspace((int) *eol))
+        line_kind |= 2;
+      if (*eol != '\n')
+        continue;
+      if (line_kind & 2)
+        shown_rows += in_rows;
+      else
+        in_rows = line_kind & 1;
+      line_kind = 0;
+      if (((row_limit > 0) && (shown_rows >= row_limit)) ||
+          ((byte_limit > 0) && (shown_bytes+(eol+1-str) >= byte_limit)))
+      {
+        write(STDOUT_FILENO, str, eol+1-str);
+        shown_bytes += eol+1-str;
+        str = eol+1;
+        limit_hit = 1;
+        limit_armed = 0;
+        kill(sqlplus_pid, SIGINT);
+        cancel_requested = 1;
+        break;
+      }
+    }
+    if (!cancel_requested)
+    {
+      write(STDOUT_FILENO, str, end-str);
+      shown_bytes += end-str;
+      return;
+    }
+  }
+  else if (!cancel_requested)
+  {
+    if (len > 0)
+      write(STDOUT_FILENO, str, len);
+    return;
+  }
+  discarded_bytes += end-str;
+  for (; (str < end) && (eol = memchr(str, '\n', end-str)); str = eol+1)
+    discarded_lines++;
+}
+
+/*
+   Get sqlplus output from `fd' and display it (*outstr is NULL)
+   without prompt, or store it in *outstr. The prompt is returned and
+   will be displayed later, by readline() (if we display it here, it
+   would get overwritten by readline()).
+   */
+static char *get_sqlplus(int fd, char *line, char **outstr)
+{
+  int  done;
+  int  cntr;
+  int  nread = 0;
+  int  plen;
+  int  llen;
+  int  olen;
+  int  capacity;
+  int  ocapacity;
+  int  pdiff;
+  char *lline;
+  char *xtr;
+  char *last_line;
+  char *otr = (char *) 0;
+  char *ptr = (char *) 0;
+  char *prompt = (char *) 0;
+
+  done = 0;
+  cntr = 0;
+  capacity = INIT_LINE_LENGTH;
+  ocapacity = INIT_LINE_LENGTH;
+     
+  //lline has the current undisplayed sqlplus content. llen is the length of the content.
+  
+  lline = malloc((capacity+1)*sizeof(char)); 
+  lline[0] = '\0';
+  llen = 0;
+  olen = 0;
+  if (outstr != (char **) 0)
+  {
+    otr = malloc((ocapacity+1)*sizeof(char));
+    ptr = otr;
+  }
+  /*
+     Read sqlplus output. We read until sqlplus sends a prompt. We
+     recognize the following prompts:
+
+     'SQL> '
+     'Enter user-name: '
+     'Enter password: '
+     'Disconnected from Oracle...' 
+     'Enter value for ...' 
+     'Specify log: {<RET>=suggested | filename | AUTO | CANCEL}'
+     numeric prompt (for multi-line SQL statements)
+     user-defined prompt (see function set_sql_prompt())
+
+     So far looks like these are the only prompts. If sqlplus sends
+     anything else, we are doomed. ljb, 05/20/2002
+     */
+  while (done == 0)
+  {
+    nread = read(fd, line, pipe_size);
+    if (nread > 0)
+    {
+      line[nread] = '\0';
+      fflush(stdout);
+      out_bytes += nread;
+      if (nread+llen > capacity)
+      {
+        while (nread+llen > capacity)
+          capacity += capacity;
+        lline = realloc(lline, capacity+1);
+      }
+      if ((outstr != (char **) 0) && (nread+olen > ocapacity))
+      {
+        while (nread+olen > ocapacity)
+          ocapacity += ocapacity;
+        pdiff = ptr-otr;
+        otr = realloc(otr, ocapacity+1);
+        ptr = otr+pdiff;
+      }
+      memcpy(&lline[llen], line, nread);
+      llen += nread;
+      lline[llen] = '\0';
+      /*
+         A multi-line statement sent in one write makes sqlplus echo a
+         continuation prompt for every line but the last. Those come
+         before anything else, and nobody wants to see them.
          */
-      spath = strdup("./sqlplus");
-      status = stat(spath, &buf);
-      if (!status) {
-        mode = check_mode(buf.st_mode);
-        if (!mode){
-          spath = sfree(spath);
+      while ((pending_prompts > 0) && (plen = numeric_prompt_len(lline)))
+      {
+        llen -= plen;
+        memmove(lline, lline+plen, llen+1);
+        pending_prompts--;
+      }
+      if ((!strncmp(lline, QUIT_PROMPT_1, strlen(QUIT_PROMPT_1)) && (state == STARTUP)) || 
+          (strstr(lline, QUIT_PROMPT_1) && (state == STARTUP)) || 
+          strstr(lline, QUIT_PROMPT_2) || strstr(lline, USAGE_PROMPT))
+      {
+        done = 1;
+        quit_sqlplus = 1;
+      }
+
+      /*
+         The following change is to address in ADE view gqlplus 
+         invocation problem.
+         */
+      if ((!strncmp(lline, VALUE_PROMPT, strlen(VALUE_PROMPT)))
+          || strstr(lline, SQL_PROMPT)
+          || strstr(lline, RECOVER_PROMPT)
+         ) 
+        done = 1;
+
+      /*
+         Display everything up to the last newline.
+         */
+      xtr = strrchr(lline, '\n');
+      if (xtr)
+      {
+        last_line = strdup(xtr+1);
+        plen = xtr-lline;
+        scan_output(lline, plen);
+        if (!outstr)
+          show_output(lline, plen);
+        else
+        {
+          memcpy(ptr, lline, plen);
+          ptr[plen] = '\0';
+          ptr += plen;
+          olen += plen;
+        }
+        /*
+           Adjust lline. After adjustment, only the last line
+           received from sqlplus, so far, remains in lline.
+           */
+        llen -= plen;
+        memcpy(lline, xtr, llen);
+        lline[llen] = '\0';
+        if ((sql_prompt && !strcmp(last_line, sql_prompt)) || 
+            !strcmp(last_line, USER_PROMPT) ||
+            !strncmp(last_line, VALUE_PROMPT, strlen(VALUE_PROMPT)) ||
+            check_time_prompt(last_line, sql_prompt) ||
+            check_password_prompt(last_line))
+          done = 1;
+        free(last_line);
+      }
+      else if ((sql_prompt && !strcmp(lline, sql_prompt)) || 
+          check_numeric_prompt(lline) ||
+          check_time_prompt(lline, sql_prompt) ||
+          check_password_prompt(lline))
+        done = 1;
+    }
+    else if (nread == 0)
+    {
+      /*
+         sqlplus has exited; get_final_sqlplus() reaps it.
+         */
+      done = 1;
+      quit_sqlplus = 1;
+    }
+    else
+    {
+      if (nread < 0)
+        perror((char *) 0);
+    }
+  }
+  /*
+     Display the remaining content, up to the last newline. Everything
+     beyond that is the prompt.
+     */
+  xtr = strrchr(lline, '\n');
+  if (xtr)
+  {
+    xtr++;
+    prompt = strdup(xtr);
+    llen -= strlen(prompt);
+    scan_output(lline, llen);
+    if (!outstr)
+      show_output(lline, llen);
+    else 
+    {
+      memcpy(ptr, lline, llen);
+      ptr[llen] = '\0';
+    }
+  }else{
+    prompt = strdup(lline);
+  }
+  if (cancel_requested && done)
+  {
+    /*
+       The prompt is back, so sqlplus has dealt with the interrupt.
+       */
+    cancel_requested = 0;
+    if (timed_out)
+      printf("\nTimed out after %.2f seconds; ", now()-timeout_armed);
+    else if (limit_hit)
+      printf("\nStopped after %lld rows (%lld bytes); ", shown_rows, shown_bytes);
+    else
+      printf("\nCancelled; ");
+    printf("%lld bytes (%lld lines) of output discarded.\n",
+        discarded_bytes, discarded_lines);
+    if (limit_hit && limit_stmt)
+    {
+      limit_offset += shown_rows;
+      printf("Use %smore to see the rows that follow.\n", szCmdPrefix);
+    }
+    printf("\n");
+    fflush(stdout);
+    timed_out = 0;
+  }
+  free(lline);
+  pending_prompts = 0;
+  if (outstr != (char **) 0){
+    *outstr = otr;
+  }
+  /*install_sigint_handler();*/
+  return prompt;
+}
+
+/*
+   A special version of get_sqlplus() supporting the 'set sqlprompt'
+   command. This function is retrieving one line from sqlplus, and that
+   line is the new sql_prompt.
+   */
+static char *set_sql_prompt(int fd, char *line)
+{
+  int  cntr;
+  int  nread = 0;
+  int  llen;
+  char *lline;
+
+  cntr = 0;
+  /* 
+     lline has the current undisplayed sqlplus content. llen is the
+     length of the content.
+     */
+  lline = malloc((MAX_PROMPT_LEN+1)*sizeof(char)); 
+  lline[0] = '\0';
+  llen = 0;
+  /*
+     Get bytes from sqlplus. We gamble here that everything will come
+     from sqlplus in one read(), since 'set sqlprompt' is a simple and
+     quick operation. If it doesn't, we are doomed.
+     */
+  nread = read(fd, line, pipe_size);
+  if (nread > 0){
+    line[nread] = '\0';
+    fflush(stdout);
+    memcpy(&lline[llen], line, nread);
+    llen += nread;
+    lline[llen] = '\0';
+    cntr++;
+  }else{
+    if (nread < 0){
+      perror((char *) 0);
+      free(lline);
+      lline = (char *) 0;
+    }
+  }
+  return lline;
+}
+
+/*
+   Read the reply of sqlplus to an ACCEPT command, or to the value
+   entered for it. Data is read as it arrives until it ends with
+   `expect' (the ACCEPT prompt, when known), or with `sql_prompt'
+   after a newline (an error message), or, when `expect' is null or
+   empty, until sqlplus goes quiet in the middle of a line. Nothing
+   waits longer than ACCEPT_WAIT ms.
+   */
+static char *read_sqlplus(int fd, char *line, char *expect, char *sql_prompt)
+{
+  int    nread;
+  int    len;
+  int    wait;
+  int    elen;
+  int    plen;
+  char   *rline;
+  double deadline;
+  struct pollfd pfd;
+
+  rline = (char *) 0;
+  len = 0;
+  elen = expect ? strlen(expect) : 0;
+  plen = sql_prompt ? strlen(sql_prompt) : 0;
+  deadline = now()+ACCEPT_WAIT/1000.0;
+  pfd.fd = fd;
+  pfd.events = POLLIN;
+  for (;;)
+  {
+    wait = (int) ((deadline-now())*1000);
+    if (wait <= 0)
+      break;
+    /*
+       Without a known prompt to look for, a partial line that stops
+       growing is taken to be the prompt, e.g. one with substitution
+       variables in it.
+       */
+    if ((elen == 0) && (len > 0) && (rline[len-1] != '\n') && (wait > ACCEPT_SETTLE))
+      wait = ACCEPT_SETTLE;
+    pfd.revents = 0;
+    nread = poll(&pfd, 1, wait);
+    if (nread < 0)
+    {
+      if (errno == EINTR)
+        continue;
+      perror("read_sqlplus()");
+      break;
+    }
+    if (nread == 0)
+      break;
+    nread = read(fd, line, pipe_size);
+    if (nread < 0)
+    {
+      if (errno == EINTR)
+        continue;
+      perror("read_sqlplus()");
+      break;
+    }
+    if (nread == 0)
+      break;
+    rline = realloc(rline, len+nread+1);
+    memcpy(&rline[len], line, nread);
+    len += nread;
+    rline[len] = '\0';
+    if ((elen > 0) && (len >= elen) && !strcmp(&rline[len-elen], expect))
+      break;
+    if ((plen > 0) && (len >= plen) && !strcmp(&rline[len-plen], sql_prompt) &&
+        ((len == plen) || memchr(rline, '\n', len-plen)))
+      break;
+  }
+  return rline;
+}
+
+/*
+   Text sqlplus will display for the PROMPT clause of ACCEPT command
+   `cmd'. Null if there is no PROMPT clause, empty if the text cannot
+   be predicted.
+   */
+static char *accept_prompt(char *cmd)
+{
+  int  i;
+  int  len;
+  char q;
+  char *ptr;
+  char *text;
+
+  for (ptr = cmd; *ptr; ptr++)
+    if (!strncasecmp(ptr, " prompt ", 8))
+      break;
+  if (*ptr == '\0')
+    return (char *) 0;
+  ptr += 7;
+  ptr += strspn(ptr, WHITESPACE);
+  len = strlen(ptr);
+  text = malloc((len+1)*sizeof(char));
+  i = 0;
+  if ((*ptr == '\'') || (*ptr == '"'))
+  {
+    q = *ptr++;
+    while (*ptr)
+    {
+      if (*ptr == q)
+      {
+        if (ptr[1] != q)
+          break;
+        ptr++;
+      }
+      text[i++] = *ptr++;
+    }
+  }
+  else
+  {
+    while (*ptr && !strchr(WHITESPACE, *ptr))
+      text[i++] = *ptr++;
+  }
+  text[i] = '\0';
+  if (strchr(text, '&'))
+    text[0] = '\0';
+  return text;
+}
+
+/*
+   Special processing for the ACCEPT sqplus command `cmd'. The special
+   processing is required because the command essentially redefines
+   prompt while the user enters value of the variable defined in the
+   ACCEPT command, thus we cannot use the standard gqlplus loop to read
+   message from sqlplus.
+   */
+static char *accept_cmd(char *cmd, int fdin, int fdout, char *sql_prompt, char *line)
+{
+  int  status;
+  int  len;
+  char *accept;
+  char *expect;
+  char *rline;
+  char *prompt;
+  char *ptr;
+  char *fline;
+
+  accept = (char *) 0;
+  /*
+     Is there a prompt? If there is, read sqlplus message (which will
+     be either the ACCEPT prompt, or an error message). Knowing the
+     prompt text lets us stop reading the moment it has arrived.
+     */
+  expect = accept_prompt(cmd);
+  if (expect)
+  {
+    accept = read_sqlplus(fdin, line, expect, sql_prompt);
+    free(expect);
+  }
+  /*
+     If this message is terminated with `sql_prompt', that means that
+     sqlplus actually returned error message. If that is the case,
+     print the first line, and return.
+     */
+  if (accept && (ptr = strchr(accept, '\n'))){
+    len = ptr-accept+1;
+    fline = malloc((len+1)*sizeof(char));
+    memcpy(fline, accept, len);
+    fline[len] = '\0';
+    printf("%s", fline);
+    fflush(stdout);
+    free(fline);
+    free(accept);
+    prompt = strdup(sql_prompt);
+  }else{
+    /*
+       Now place user input in `rline' using readline().
+       */
+    rline = readline(accept);
+    if (accept)
+      free(accept);
+    if (!rline)
+      rline = strdup("");
+    /*
+       Send it to sqlplus.
+       */
+    write(fdout, rline, strlen(rline));
+    free(rline);
+    /*
+       Terminate the user input sent to sqlplus.
+       */
+    status = write(fdout, "\n", 1);
+    if (status == -1){
+      fprintf(stderr, "sqlplus terminated - exiting...\n");
+      exit(-1);
+    }
+    /*
+       Now read the message sent from sqlplus, which should be the SQL
+       prompt. We don't display it, since that will be done by the
+       subsequent readline() call.
+       */
+    prompt = read_sqlplus(fdin, line, (char *) 0, sql_prompt);
+  }
+  return prompt;
+}
+
+/*
+   Extract tokens (separated by characters in 'delimiter' string) from
+   'str'. Return NULL-terminated array of tokens.
+
+   The function allocates the space for the returned array. It is the
+   caller's responsibility to free it.
+   */
+static char **str_tokenize(char *str, char *delimiter)
+{
+  int  len;
+  int  i;
+  int  rlen;
+  int  cntr;
+  int  capacity = INIT_LENGTH;
+  char *xtr;
+  char *ptr;
+  char **tokens;
+  char **xtokens;
+
+  tokens = (char **) 0;
+  cntr = 0;
+  if ((str != (char *) 0) && (delimiter != (char *) 0))
+  {
+    rlen = strlen(str);
+    if (rlen > 0)
+    {
+      tokens = malloc(INIT_LENGTH*sizeof(char *));
+      capacity = INIT_LENGTH;
+    }
+    xtr = str;
+    while (rlen > 0)
+    {
+      len = strspn(xtr, delimiter);
+      xtr += len;
+      rlen -= len;
+      len = strcspn(xtr, delimiter);
+      rlen -= len;
+      if (len > 0)
+      {
+        ptr = malloc(len+1);
+        memcpy(ptr, xtr, len);
+        ptr[len] = '\0';
+        xtr += len;
+        tokens[cntr++] = ptr;
+        if (cntr >= capacity)
+        {
+          capacity += capacity;
+          xtokens = malloc(capacity*sizeof(char *));
+          for (i = 0; i < cntr; i++)
+          {
+            xtokens[i] = strdup(tokens[i]);
+            free(tokens[i]);
+          }
+          free(tokens);
+          tokens = xtokens;
+        }
+      }
+    }
+    if (tokens)
+      tokens[cntr] = (char *) 0;
+  }
+  return tokens;
+}
+
+static void str_free(char **tokens)
+{
+  int i;
+
+  i = 0;
+  if (tokens)
+    while (tokens[i] != (char *) 0)
+      free(tokens[i++]);
+  free(tokens);
+}
+
+static char *sfree(char *str)
+{
+  free(str);
+  return (char *) 0;
+}
+
+/*
+   Assemble the lines of a multi-line statement into a single history
+   entry. `rline' was typed at `prompt'; lines typed at a numeric
+   (continuation) prompt are appended to `stmt', anything else starts
+   a new statement. Return the statement assembled so far.
+   */
+static char *add_statement_line(char *stmt, const char *rline, const char *prompt)
+{
+  int len;
+
+  if (stmt && check_numeric_prompt(prompt))
+  {
+    len = strlen(stmt);
+    stmt = realloc(stmt, len+strlen(rline)+2);
+    stmt[len] = '\n';
+    strcpy(stmt+len+1, rline);
+  }
+  else
+  {
+    free(stmt);
+    stmt = *rline ? strdup(rline) : (char *) 0;
+  }
+  return stmt;
+}
+
+/*
+   Append statement `stmt', which ran from `start' until now, to the
+   --!capture file, with the time the user took before it and the
+   time it ran; see run_replay(). Connecting, quitting, editing and
+   the commands of gqlplus itself are not part of the workload.
+   */
+static void capture_statement(const char *stmt, double start)
+{
+  char   *lstmt;
+  char   *ptr;
+  const char *args;
+  enum command_id cmd;
+  double end;
+
+  end = now();
+  lstmt = lower_line(stmt);
+  ptr = lstmt+strspn(lstmt, WHITESPACE);
+  cmd = classify_command(lstmt, &args);
+  if (strncmp(ptr, szCmdPrefix, strlen(szCmdPrefix)) &&
+      (cmd != CMD_CONNECT) && (cmd != CMD_DISCONNECT) && (cmd != CMD_QUIT) &&
+      (cmd != CMD_EDIT) && (cmd != CMD_PAUSE) && (cmd != CMD_ACCEPT) &&
+      strncmp(ptr, EXIT_CMD, strlen(EXIT_CMD)) && (*ptr != '!') && strncmp(ptr, HOST_CMD, strlen(HOST_CMD)))
+  {
+    fprintf(capture_file, "%s %.6f think %.3f elapsed %.3f bytes %d\n%s\n", CAPTURE_HEADER,
+        start, (start > capture_end) ? start-capture_end : 0.0, end-start, (int) strlen(stmt), stmt);
+    fflush(capture_file);
+  }
+  capture_end = end;
+}
+
+/*
+   --!capture file starts recording the statements, --!capture off
+   stops.
+   */
+static void set_capture(char *args)
+{
+  if (args && strcasecmp(args, "off"))
+  {
+    if (capture_file)
+      fclose(capture_file);
+    if (!(capture_file = fopen(args, "a")))
+      perror(args);
+    else
+    {
+      capture_end = now();
+      printf("Capturing statements to %s.\n", args);
+    }
+  }
+  else if (args)
+  {
+    if (capture_file)
+      fclose(capture_file);
+    capture_file = (FILE *) 0;
+    printf("Capture off.\n");
+  }
+  else
+    printf("Usage: %scapture [file|off]\n", szCmdPrefix);
+}
+
+/*
+   Record statement `stmt' in history once sqlplus has stopped asking
+   for continuation lines, i.e., `prompt' is not a numeric prompt.
+   Return NULL if the statement was recorded, `stmt' otherwise.
+   */
+static char *finish_statement(char *stmt, const char *prompt, double start)
+{
+  if (stmt && !check_numeric_prompt(prompt))
+  {
+    record_history(stmt, start);
+    if (capture_file)
+      capture_statement(stmt, start);
+    stmt = sfree(stmt);
+  }
+  return stmt;
+}
+
+static char *str_expand(char *str, int *capacity, int length, int extension)
+{
+  int  new_length;
+  char *xstr;
+
+  xstr = str;
+  new_length = length+extension;
+  if (new_length > *capacity)
+  {
+    while (*capacity <= new_length)
+      *capacity += *capacity;
+    xstr = realloc(str, *capacity+1);
+  }
+  return xstr;
+}
+
+/*
+   Client-side statement splitter. SQL*Plus reads a SQL statement up to
+   a line that ends with ';', a line holding only '/' or '.', or a blank
+   line, and a PL/SQL block up to a '/' or '.' line. gqlplus applies the
+   same rules to what is typed at the SQL prompt: continuation lines are
+   read locally, under numbered prompts like those of sqlplus, and the
+   complete statement goes to sqlplus in a single write instead of one
+   round trip through sqlplus per line.
+
+   Like SQL*Plus, the end-of-line rules hold inside string literals and
+   comments; quotes and comments only matter when looking for the
+   keywords that tell a statement from a SQL*Plus command. Should
+   sqlplus still want more (a different SQLTERMINATOR, SQLBLANKLINES
+   ON), it sends its numeric prompt and gqlplus carries on as before.
+   */
+#define STMT_NONE        0 /* SQL*Plus command: a single line */
+#define STMT_SQL         1
+#define STMT_PLSQL       2
+#define STMT_WORD_LENGTH 129 /* room for any Oracle identifier */
+
+static const char *sql_keywords[] =
+{
+  "alter", "analyze", "audit", "call", "comment", "commit", "create",
+  "delete", "drop", "explain", "flashback", "grant", "insert", "lock",
+  "merge", "noaudit", "purge", "rename", "revoke", "rollback",
+  "savepoint", "select", "truncate", "update", "with", "(",
+  (char *) 0
+};
+
+static const char *plsql_objects[] =
+{
+  "function", "procedure", "package", "trigger", "type", "library",
+  "java", (char *) 0
+};
+
+/*
+   Copy the next word of `*str', skipping blanks and comments, to
+   `word' in lowercase and advance `*str' past it. Return 0 at the end
+   of the line or of an unterminated comment.
+   */
+static int statement_word(const char **str, char *word)
+{
+  int  len;
+  const char *ptr;
+
+  ptr = *str;
+  for (;;)
+  {
+    ptr += strspn(ptr, WHITESPACE);
+    if (!strncmp(ptr, "/*", 2))
+    {
+      if (!(ptr = strstr(ptr+2, "*/")))
+        return 0;
+      ptr += 2;
+    }
+    else if (!*ptr || !strncmp(ptr, "--", 2))
+      return 0;
+    else
+      break;
+  }
+  len = 0;
+  if (!isalnum((int) *ptr) && !strchr("_$#", *ptr))
+    word[len++] = *ptr++;
+  else
+    for (; isalnum((int) *ptr) || strchr("_$#", *ptr); ptr++)
+      if (len < STMT_WORD_LENGTH-1)
+        word[len++] = tolower((int) *ptr);
+  word[len] = '\0';
+  *str = ptr;
+  return 1;
+}
+
+/*
+   Tell from its first line whether `line' starts a SQL statement, a
+   PL/SQL block or neither.
+   */
+static int statement_kind(const char *line)
+{
+  int  i;
+  char word[STMT_WORD_LENGTH];
+
+  if (!statement_word(&line, word))
+    return STMT_NONE;
+  if (!strcmp(word, "declare") || !strcmp(word, "begin"))
+    return STMT_PLSQL;
+  if (!strcmp(word, "create"))
+  {
+    while (statement_word(&line, word) &&
+           (!strcmp(word, "or") || !strcmp(word, "replace") ||
+            !strcmp(word, "editionable") || !strcmp(word, "noneditionable") ||
+            !strcmp(word, "and") || !strcmp(word, "compile") ||
+            !strcmp(word, "resolve") || !strcmp(word, "noforce")))
+      ;
+    for (i = 0; plsql_objects[i]; i++)
+      if (!strcmp(word, plsql_objects[i]))
+        return STMT_PLSQL;
+    return STMT_SQL;
+  }
+  for (i = 0; sql_keywords[i]; i++)
+    if (!strcmp(word, sql_keywords[i]))
+      return STMT_SQL;
+  return STMT_NONE;
+}
+
+/*
+   Return 1 if `line' ends a statement of kind `kind'.
+   */
+static int statement_ends(const char *line, int kind)
+{
+  int  len;
+  const char *ptr;
+
+  line += strspn(line, WHITESPACE);
+  len = strlen(line);
+  while ((len > 0) && isspace((int) line[len-1]))
+    len--;
+  if ((len == 1) && ((*line == '/') || (*line == '.')))
+    return 1;
+  if (kind != STMT_SQL)
+    return 0;
+  if ((len == 0) || (line[len-1] == ';'))
+    return 1;
+  /*
+     A comment after the ';' is taken as the end too: sending a
+     statement early only costs the round trip it was meant to save.
+     */
+  for (ptr = line; (ptr = strchr(ptr, ';')); )
+  {
+    ptr++;
+    ptr += strspn(ptr, WHITESPACE);
+    if (!strncmp(ptr, "--", 2))
+      return 1;
+  }
+  return 0;
+}
+
+/*
+   `rline' was typed at the SQL prompt. If it starts a statement that
+   it does not complete, read the rest of the statement and return all
+   of it, one line per line; otherwise return `rline' as it is.
+   */
+static char *read_statement(char *rline)
+{
+  int  kind;
+  int  n;
+  int  len;
+  int  mlen;
+  int  capacity;
+  char *more;
+  char cprompt[32];
+
+  kind = statement_kind(rline);
+  if ((kind == STMT_NONE) || ((kind == STMT_SQL) && statement_ends(rline, kind)))
+    return rline;
+  len = strlen(rline);
+  capacity = len;
+  suggest_active = 0;
+  for (n = 2; ; n++)
+  {
+    sprintf(cprompt, "%3d  ", n);
+    more = readline(cprompt);
+    if (!more)
+      break;
+    mlen = strlen(more);
+    rline = str_expand(rline, &capacity, len, mlen+1);
+    rline[len++] = '\n';
+    memcpy(rline+len, more, mlen+1);
+    len += mlen;
+    free(more);
+    if (statement_ends(rline+len-mlen, kind))
+      break;
+  }
+  return rline;
+}
+
+/*
+   SQL*Plus commands that leave the SQL buffer alone, with the shortest
+   abbreviation SQL*Plus accepts. Anything else sent at the SQL prompt
+   (@, GET, INPUT, APPEND, CHANGE, DEL, ...) makes the local copy of
+   the buffer unknown.
+   */
+static const struct command buffer_neutral[] =
+{
+  { "accept",       3, 0, CMD_NONE },
+  { "break",        3, 0, CMD_NONE },
+  { "btitle",       3, 0, CMD_NONE },
+  { "column",       3, 0, CMD_NONE },
+  { "compute",      4, 0, CMD_NONE },
+  { "connect",      4, 0, CMD_NONE },
+  { "define",       3, 0, CMD_NONE },
+  { "describe",     4, 0, CMD_NONE },
+  { "disconnect",   4, 0, CMD_NONE },
+  { "execute",      4, 0, CMD_NONE },
+  { "help",         4, 0, CMD_NONE },
+  { "host",         2, 0, CMD_NONE },
+  { "list",         1, 0, CMD_NONE },
+  { "password",     5, 0, CMD_NONE },
+  { "pause",        3, 0, CMD_NONE },
+  { "print",        3, 0, CMD_NONE },
+  { "prompt",       3, 0, CMD_NONE },
+  { "remark",       3, 0, CMD_NONE },
+  { "run",          1, 0, CMD_NONE },
+  { "save",         3, 0, CMD_NONE },
+  { "set",          3, 0, CMD_NONE },
+  { "show",         3, 0, CMD_NONE },
+  { "spool",        3, 0, CMD_NONE },
+  { "timing",       4, 0, CMD_NONE },
+  { "ttitle",       3, 0, CMD_NONE },
+  { "undefine",     5, 0, CMD_NONE },
+  { "variable",     3, 0, CMD_NONE },
+  { "whenever",     5, 0, CMD_NONE },
+  { "/",            1, 0, CMD_NONE },
+  { ";",            1, 0, CMD_NONE },
+  { "!",            1, 0, CMD_NONE },
+  { (char *) 0,     0, 0, CMD_NONE }
+};
+
+/*
+   Keep the local copy of the sqlplus SQL buffer, `sql_buffer', up to
+   date with `rline', about to be sent to sqlplus. `sql_input' is 1 if
+   it was typed at the SQL prompt. A statement replaces the buffer,
+   without the line or ';' that ended it; commands that may change the
+   buffer, and lines sqlplus asked for itself, make it unknown.
+   */
+static void mirror_sql_buffer(const char *rline, int sql_input)
+{
+  int  kind;
+  int  len;
+  const char *ptr;
+  const struct command *cmd;
+  char word[STMT_WORD_LENGTH];
+
+  if (!sql_input)
+  {
+    sql_buffer = sfree(sql_buffer);
+    return;
+  }
+  kind = statement_kind(rline);
+  if (kind == STMT_NONE)
+  {
+    ptr = rline;
+    if (!statement_word(&ptr, word))
+      return; /* comment */
+    len = strlen(word);
+    for (cmd = buffer_neutral; cmd->keyword; cmd++)
+      if ((len >= cmd->abbrev) && !strncmp(cmd->keyword, word, len))
+        break;
+    if (!cmd->keyword || ((*word == 'c') && (len == 2) && strstr(ptr, "buff")))
+      sql_buffer = sfree(sql_buffer);
+    return;
+  }
+  free(sql_buffer);
+  sql_buffer = strdup(rline);
+  ptr = strrchr(sql_buffer, '\n');
+  ptr = ptr ? ptr+1 : sql_buffer;
+  if (statement_ends(ptr, STMT_PLSQL) || !ptr[strspn(ptr, WHITESPACE)])
+    len = (ptr > sql_buffer) ? ptr-sql_buffer-1 : 0;
+  else
+  {
+    len = strlen(sql_buffer);
+    while ((len > 0) && isspace((int) sql_buffer[len-1]))
+      len--;
+    if ((len == 0) || (sql_buffer[len-1] != ';'))
+    {
+      sql_buffer = sfree(sql_buffer); /* ';' followed by a comment */
+      return;
+    }
+    len--;
+  }
+  sql_buffer[len] = '\0';
+  if (!len)
+    sql_buffer = sfree(sql_buffer);
+}
+
+/*
+   Return 1 if file described by `st_mode' is regular executable file.
+   */
+static int check_mode(mode_t st_mode)
+{
+  int mode;
+  mode_t mode1;
+  mode_t mode2;
+
+  mode = 0;
+  mode1 = S_ISREG(st_mode);
+  if (mode1)
+  {
+    mode2 = S_IXUSR;
+    mode = st_mode & S_IXUSR;
+  }
+  return mode;
+}
+
+/*
+   Search PATH for executable `exe'. Return full path to exe.
+   */
+static char *search_path(char *exe)
+{
+  int  i;
+  int  status;
+  int  done;
+  int  mode;
+  char *path;
+  char *env;
+  char *str;
+  char *xtr;
+  char **dirs;
+  struct stat buf;
+
+  path = (char *) 0;
+  env = getenv(PATH);
+  if (env)
+  {
+    dirs = str_tokenize(env, ":");
+    i = 0;
+    str = malloc(strlen(env)+strlen(exe)+2);
+    done = 0;
+    while (((xtr = dirs[i++]) != (char *) 0) && !done)
+    {
+      sprintf(str, "%s/%s", xtr, exe);
+      status = stat(str, &buf);
+      if (!status)
+      {
+        mode = check_mode(buf.st_mode);
+        if (mode)
+        {
+          path = str;
+          done = 1;
+        }
+      }
+    }
+    str_free(dirs);
+  }
+  return path;
+}
+
+/*
+   Search PATH for file named `exe' with proper permissions. Return
+   full path to the file.
+   */
+static char *search_exe(char *exe)
+{
+  int  status;
+  int  mode;
+  char *path;
+  char *lpath;
+  struct stat buf;
+
+  path = (char *) 0;
+  lpath = search_path(exe);
+  if (lpath)
+  {
+    /*
+       Check permissions.
+       */
+    status = stat(lpath, &buf);
+    if (!status) 
+    {
+      mode = check_mode(buf.st_mode);
+      if (mode)
+        path = lpath;
+    }
+  }
+  return path;
+}
+
+char *get_env(char *name)
+{
+  char *xtr;
+  char *env;
+
+  xtr = getenv(name);
+  if (xtr != (char *) 0)
+  {
+    env = malloc(strlen(name)+strlen(xtr)+2);
+    sprintf(env, "%s=%s", name, xtr);
+  }
+  else
+    env = strdup("");
+  return env;
+}
+
+char **get_environment(void)
+{
+  int  idx;
+  char *env;
+  char **enx;
+
+  enx = calloc(MAX_NENV+1, sizeof(char *));
+  env = get_env(ORACLE_HOME);
+  idx = 0;
+  enx[idx++] = env;
+  enx[idx++] = get_env(ORACLE_SID);
+  enx[idx++] = get_env(TNS_ADMIN);
+  enx[idx++] = get_env(SQLPATH);
+  enx[idx++] = get_env(NLS_LANG); /* added by dbakorea */
+  enx[idx++] = get_env(ORA_NLS33); /* added by dbakorea */
+  enx[idx++] = get_env(NLS_DATE_FORMAT); /* added by leeym */
+  enx[idx++] = get_env(NLS_COMP); 
+  enx[idx++] = get_env(NLS_SORT); 
+  enx[idx++] = get_env(LD_LIBRARY_PATH); 
+  enx[idx++] = get_env(DYLD_LIBRARY_PATH); 
+  enx[idx++] = get_env(ORACLE_PATH);
+  enx[idx++] = get_env(TWO_TASK); 
+  return enx;
+}
+
+static void print_environment(char **enx)
+{
+  int  idx;
+  char *env;
+
+  idx = 0;
+  while (enx[idx])
+    printf("enx[%d]: '%s'\n", idx, enx[idx++]);
+}
+
+/*
+   Find the location of `sqlplus' binary. `orahome' is the value of
+   ORACLE_HOME environment variable, if it is defined.
+
+   The rules are as follows:
+
+   - look for executable binary `sqlplus' in PATH
+   - if not found, look for executable binary `sqlplus' in
+   ORACLE_HOME/bin
+   - if not found, look for executable binary `sqlplus' in the current
+   directory
+
+   Return full path of the binary. Return NULL if it doesn't exist or
+   isn't executable.
+   */
+static char *stat_sqlplus(const char *orahome)
+{
+  int status = 0;
+  int mode;
+  char *spath;
+  struct stat buf;
+
+  /*
+     Check PATH for sqlplus binary.
+     */
+  spath = getenv("SQLPLUS_BIN");
+  if (!spath){
+    spath = search_exe("sqlplus");
+    if (orahome){
+      /*
+         Not found, check $ORACLE_HOME/bin.
+         */
+      spath = malloc(strlen(orahome)+30);
+      sprintf(spath, "%s/bin/sqlplus", orahome);
+      status = stat(spath, &buf);
+      if (!status) {
+        mode = check_mode(buf.st_mode);
+        if (!mode){
+          spath = sfree(spath);
+        }
+      }else{
+        spath = sfree(spath);
+      }
+    }
+    if (!spath){
+      /*
+         Check the current directory.
+         */
+      spath = strdup("./sqlplus");
+      status = stat(spath, &buf);
+      if (!status) {
+        mode = check_mode(buf.st_mode);
+        if (!mode){
+          spath = sfree(spath);
+        }
+      }else{
+        spath = sfree(spath);
+      }
+    }
+  }
+  return spath;
+}
+
+/*
+   Read 'fname' into string.
+   */
+static char *read_file(const char *fname, char *line)
+{
+  int  status;
+  int  len;
+  char *str = (char *) 0;
+  char *xtr;
+  struct stat buf;
+  FILE *fptr;
+
+  fptr = fopen(fname, "r");
+  if (fptr != (FILE *) 0){
+    status = stat(fname, &buf);
+    if (status == 0){
+      str = malloc((buf.st_size+1)*sizeof(char));
+      if (str != (char *) 0){
+        xtr = str;
+        while (fgets(line, MAX_LINE_LENGTH, fptr)){
+          len = strlen(line);
+          memcpy(xtr, line, len);
+          xtr += len;
+        }
+        fclose(fptr);
+        *xtr = '\0';
+      }
+    }
+  }
+  return str;
+}
+
+
+/*
+   Extract basename of 'path'. Like basename() (not available on all
+   platforms).
+   */
+static char *bname(char *path)
+{
+  char *xtr;
+  char *bname = (char *) 0;
+
+  if (path && *path)
+  {
+    xtr = strrchr(path, '/');
+    if (xtr)
+    {
+      xtr++;
+      bname = strdup(xtr);
+    }
+    else
+      bname = strdup(path);
+  }
+  return bname;
+}
+
+/*
+   Extract EDITOR values from 'str'. 
+   */
+static char **set_editor(char *str)
+{
+  char *ptr;
+  char *xtr;
+  char **editor = (char **) 0;
+
+  if (str && *str && (ptr = strrchr(str, '=')))
+  {
+    ptr++;
+    ptr += strspn(ptr, " \"");
+    xtr = strdup(ptr);
+    ptr = strrchr(xtr, ';');
+    if (ptr)
+      *ptr = '\0';
+    ptr = strrchr(xtr, '"');
+    if (ptr)
+      *ptr = '\0';
+    /*
+       We have the 'define _editor' string, now extract tokens.
+       */
+    editor = str_tokenize(xtr, " ");
+    /*
+       Remove end-of-line.
+       */
+    if ((ptr = strchr(editor[0], '\n')))
+      *ptr = '\0';
+    _editor = strdup(editor[0]);
+    if (*editor[0] != '/')
+      editor[0] = search_path(editor[0]);
+    free(xtr);
+  }
+  return editor;
+}
+
+/*
+   Check if file 'fptr' contains an editor definition line.
+   */
+static char **file_editor(FILE *fptr, char *line)
+{
+  char **editor = (char **) 0;
+
+  while (fgets(line, MAX_LINE_LENGTH, fptr) && (editor == (char **) 0))
+    if ((line[0] != '#') && strstr(line, DEFINE_CMD) && (strstr(line, EDITOR)))
+      editor = set_editor(line);
+  fclose(fptr);
+  return editor;
+}
+
+/*
+   Extract EDITOR definition from glogin.sql and login.sql files.
+
+   sqlplus takes settings from glogin.sql in
+   ${ORACLE_HOME}/sqlplus/admin directory first. Then it looks for
+   login.sql file in the local directory, followed by directories in
+   ${SQLPATH}. Note that as soon as login.sql is found in any of these
+   directories, the search stops.
+   */
+static char **file_set_editor(char *line)
+{
+  int  found;
+  int  cntr;
+  char *path;
+  char **editor = (char **) 0;
+  char **sqlpath;
+  char *oracle_home;
+  FILE *fptr;
+
+  path = malloc(1024);
+  /*
+     Check local directory first.
+     */
+  found = 0;
+  strcpy(path, "login.sql");
+  fptr = fopen(path, "r");
+  if (fptr)
+  {
+    found = 1;
+    editor = file_editor(fptr, line);
+  }
+  /*
+     If login.sql is not found in the local directory, check SQLPATH
+     directories.
+     */
+  sqlpath = str_tokenize(getenv("SQLPATH"), ":");
+  if (sqlpath)
+  {
+    cntr = 0;
+    while (!found && sqlpath[cntr])
+    {
+      sprintf(path, "%s/login.sql", sqlpath[cntr]);
+      cntr++;
+      fptr = fopen(path, "r");
+      if (fptr)
+      {
+        found = 1;
+        editor = file_editor(fptr, line);
+      }
+    }
+    str_free(sqlpath);
+  }
+  if (!found)
+  {
+    /*
+       login.sql not found. Check ${ORACLE_HOME}/sqlplus/admin/gqlplus.sql.
+       */
+    oracle_home = getenv("ORACLE_HOME");
+    if (oracle_home)
+    {
+      sprintf(path, "%s/sqlplus/admin/glogin.sql", oracle_home);
+      fptr = fopen(path, "r");
+      if (fptr)
+      {
+        found = 1;
+        editor = file_editor(fptr, line);
+      }
+    }
+  }
+  free(path);
+  return editor;
+}
+
+/*
+   Send 'xtr' to sqlplus using 'i' command.
+   */                        
+static void free_nta(char **nta)
+{
+  int i;
+
+  if (nta != (char **) 0)
+  {
+    i = 0;
+    while (nta[i] != (char *) 0)
+      free(nta[i++]);
+    free(nta);
+  }
+}
+
+/*
+   Implement 'PAUSE ON' mode, and the PAUSE command. Requires special
+   processing, since during the dialogue with sqlplus no prompt is
+   returned.
+
+   With `first_flag' set (the PAUSE command) sqlplus is waiting for
+   Enter, so the first key typed is passed on to it. Otherwise `line'
+   is a query run under SET PAUSE ON, and its output is paged here:
+   space shows the next page, Enter the next line, `/' searches for a
+   string (`n' repeats the search) and `q' cancels the rest of the
+   fetch. While a page is on the screen we stop reading the pipe, so
+   sqlplus stops fetching as soon as the pipe fills up.
+
+   Both the pipe and the terminal are waited for in poll(); nothing
+   here guesses whether sqlplus has finished.
+   */
+static void pause_cmd(int fdin, int fdout, char *line, char *sql_prompt, int first_flag)
+{
+  int    nread;
+  int    n;
+  int    len;
+  int    start;
+  int    capacity;
+  int    rows;
+  int    cols;
+  int    page;
+  int    left;
+  int    nfds;
+  int    tty;
+  int    more;
+  int    quit;
+  int    key_sent;
+  int    searching;
+  int    found;
+  int    plen;
+  char   c;
+  char   *nl;
+  char   *prompt;
+  char   *buffer;
+  char   *pattern;
+  char   *pline;
+  struct termios save;
+  struct termios raw;
+  struct pollfd pfd[2];
+
+  prompt = sql_prompt ? sql_prompt : SQL_PROMPT;
+  /*
+     Send the command to sqlplus.
+     */
+  write(fdout, line, strlen(line));
+  write(fdout, "\n", 1);
+  /*
+     Keys are taken one at a time, without echo.
+     */
+  tty = (tcgetattr(STDIN_FILENO, &save) == 0);
+  if (tty)
+  {
+    raw = save;
+    raw.c_lflag &= ~(ICANON | ECHO);
+    raw.c_cc[VMIN] = 1;
+    raw.c_cc[VTIME] = 0;
+    tcsetattr(STDIN_FILENO, TCSADRAIN, &raw);
+  }
+  rl_get_screen_size(&rows, &cols);
+  page = (rows > 2) ? rows-1 : 23;
+  left = page;
+  capacity = pipe_size;
+  buffer = malloc((capacity+1)*sizeof(char));
+  buffer[0] = '\0';
+  len = 0;
+  start = 0;
+  more = 0;
+  quit = 0;
+  key_sent = 0;
+  searching = 0;
+  found = 0;
+  pattern = (char *) 0;
+  for (;;)
+  {
+    quit = cancel_requested;
+    if (quit && more)
+    {
+      fputs("\r\033[K", stdout);
+      fflush(stdout);
+      more = 0;
+    }
+    /*
+       Show (or skip) the complete lines we are allowed to.
+       */
+    while ((first_flag || quit || searching || (left > 0)) &&
+           (nl = memchr(&buffer[start], '\n', len-start)))
+    {
+      n = nl-&buffer[start]+1;
+      scan_output(&buffer[start], n);
+      if (searching)
+      {
+        buffer[start+n-1] = '\0';
+        if (strstr(&buffer[start], pattern))
+        {
+          searching = 0;
+          found = 1;
+          left = page;
+        }
+        buffer[start+n-1] = '\n';
+      }
+      if (!searching)
+      {
+        show_output(&buffer[start], n);
+        left--;
+      }
+      start += n;
+    }
+    len -= start;
+    memmove(buffer, &buffer[start], len);
+    buffer[len] = '\0';
+    start = 0;
+    /*
+       All that is left ends with the prompt (SET TIME ON puts the time
+       in front of it): sqlplus is done.
+       */
+    plen = strlen(prompt);
+    if ((len >= plen) && !strcmp(&buffer[len-plen], prompt) && (!first_flag || key_sent))
+      break;
+    if (!first_flag && !quit && !searching && (left <= 0) && memchr(buffer, '\n', len))
+    {
+      if (!more)
+      {
+        fputs("\033[7m--More--\033[0m", stdout);
+        fflush(stdout);
+        more = 1;
+      }
+      nfds = 0;
+    }
+    else
+    {
+      pfd[0].fd = fdin;
+      pfd[0].events = POLLIN;
+      pfd[0].revents = 0;
+      nfds = 1;
+    }
+    if ((more || (first_flag && !key_sent)) && !quit)
+    {
+      pfd[nfds].fd = STDIN_FILENO;
+      pfd[nfds].events = POLLIN;
+      pfd[nfds].revents = 0;
+      nfds++;
+    }
+    if (nfds == 0)
+      break;
+    if (poll(pfd, nfds, -1) < 0)
+    {
+      if (errno == EINTR)
+        continue;
+      perror("pause_cmd()");
+      break;
+    }
+    if ((pfd[0].fd == fdin) && (pfd[0].revents & (POLLIN | POLLHUP)))
+    {
+      if (len+pipe_size > capacity)
+      {
+        while (len+pipe_size > capacity)
+          capacity += capacity;
+        buffer = realloc(buffer, capacity+1);
+      }
+      nread = read(fdin, &buffer[len], pipe_size);
+      if (nread < 0)
+      {
+        if (errno == EINTR)
+          continue;
+        perror("pause_cmd()");
+        break;
+      }
+      if (nread == 0)
+        break;
+      out_bytes += nread;
+      len += nread;
+      buffer[len] = '\0';
+      /*
+         The continuation prompts of a multi-line statement, as in
+         get_sqlplus().
+         */
+      while ((pending_prompts > 0) && (plen = numeric_prompt_len(buffer)))
+      {
+        len -= plen;
+        memmove(buffer, buffer+plen, len+1);
+        pending_prompts--;
+      }
+    }
+    if ((pfd[nfds-1].fd == STDIN_FILENO) && pfd[nfds-1].revents)
+    {
+      if (read(STDIN_FILENO, &c, 1) <= 0)
+        c = 'q';
+      if (first_flag)
+      {
+        write(fdout, "\n", 1);
+        write(STDOUT_FILENO, "\n", 1);
+        key_sent = 1;
+        continue;
+      }
+      fputs("\r\033[K", stdout);
+      fflush(stdout);
+      more = 0;
+      switch (c)
+      {
+        case ' ':
+          left = page;
+          break;
+        case '\r':
+        case '\n':
+        case 'j':
+          left = 1;
+          break;
+        case 'q':
+        case 'Q':
+          /*
+             Stop sqlplus fetching, and throw away what it has
+             already sent.
+             */
+          kill(sqlplus_pid, SIGINT);
+          cancel_requested = 1;
+          break;
+        case '/':
+          if (tty)
+            tcsetattr(STDIN_FILENO, TCSADRAIN, &save);
+          suggest_active = 0;
+          pline = readline("/");
+          if (tty)
+            tcsetattr(STDIN_FILENO, TCSADRAIN, &raw);
+          if (pline && *pline)
+          {
+            free(pattern);
+            pattern = pline;
+          }
+          else
+            free(pline);
+          /* fall through */
+        case 'n':
+          if (pattern)
+          {
+            fputs("...skipping\n", stdout);
+            fflush(stdout);
+            searching = 1;
+            found = 0;
+          }
+          break;
+        default:
+          break;
+      }
+    }
+  }
+  if (searching && !found)
+  {
+    printf("Pattern not found\n");
+    fflush(stdout);
+  }
+  if (tty)
+    tcsetattr(STDIN_FILENO, TCSADRAIN, &save);
+  pending_prompts = 0;
+  free(pattern);
+  free(buffer);
+}
+
+/*
+   Implement sqlplus 'edit' command. The command works in two modes:
+   first, if no 'fname' is given, it launches editing session of
+   afiedt.buf file, and sends the edited file to to sqlplus; if fname
+   is given, it opens it.
+   */
+static int edit(int fdin, int fdout, char *line, char **editor, char *fname)
+{
+  int   child_stat;
+  int   status;
+  int   i;
+  int   xc;
+  int   len;
+  int   done;
+  pid_t pid;
+  char  *path;
+  char  *str;
+  char  *xtr;
+  char  *ptr;
+  char  *afiedt;
+  char  *prompt;
+  char  *rname;
+  char  *newline;
+  char  **xrgs = (char **) 0;
+  char  **enx = (char **) 0;
+  FILE  *fptr;
+
+  status = 0;
+  str = (char *) 0;
+  prompt = (char *) 0;
+  rname = (char *) 0;
+  if (fname)
+  {
+    /*
+       Optionally add .sql extension to fname.
+       */
+    ptr = strstr(fname, SQLEXT);
+    if (ptr && (strlen(ptr) == strlen(SQLEXT)))
+      rname = strdup(fname);
+    else
+    {
+      rname = malloc((strlen(fname)+strlen(SQLEXT)+1)*sizeof(char));
+      sprintf(rname, "%s%s", fname, SQLEXT);
+    }
+  }
+  else
+  {
+    /*
+       Put last SQL statement in afiedt.buf, then open it in editor. It
+       comes from the local copy of the SQL buffer; only if that is not
+       known, from sqlplus.
+       */
+    if (!sql_buffer)
+    {
+      write(fdout, LIST_CMD, strlen(LIST_CMD));
+      prompt = get_sqlplus(fdin, line, &str);
+    }
+    /* TBD: afiedt.buf filename hardcoded. */
+    rname = strdup(AFIEDT);
+  }
+  if (fname || sql_buffer || !strstr(str, NO_LINES))
+  {
+    if (!fname)
+      fptr = fopen(rname, "w");
+    if (fptr || fname)
+    {
+      if (!fname && sql_buffer)
+        fprintf(fptr, "%s\n/\n", sql_buffer);
+      else if (!fname)
+      {
+        /*
+           Have to clean-up the numeric prompt (5 characters) coming back
+           from the LIST_CMD.
+           */
+        xtr = str;
+        while ((ptr = strchr(xtr, '\n')) != (char *) 0)
+        {
+          len = ptr-xtr;
+          *ptr = '\0';
+          fprintf(fptr, "%s\n", xtr+5);
+          xtr += len+1;
+        }
+        fprintf(fptr, "/\n");
+      }
+      if (!fname)
+        status = fclose(fptr);
+      if (!status)
+      {
+        free(str);
+        free(prompt);
+        path = editor[0];
+        xc = 0;
+        while (editor[xc++] != (char *) 0);
+        xrgs = calloc(xc+5, sizeof(char *));
+        xc = 0;
+        xrgs[xc++] = bname(path);
+        i = 1;
+        while (editor[i] != (char *) 0)
+        {
+          if ((newline = strchr(editor[i], '\n')))
+            *newline = '\0';
+          xrgs[xc++] = strdup(editor[i]);
+          i++;
+        }
+        xrgs[xc++] = strdup(rname);
+        /*
+           Launch emacs in a separate window.
+           */
+        if (!strcmp(xrgs[0], "emacs"))
+          if (!(xrgs[1] && !strcmp(xrgs[1], "-nw")))
+          {
+            if (getenv("DISPLAY"))
+            {
+              xrgs[xc++] = strdup("-d");
+              xrgs[xc++] = strdup(getenv("DISPLAY"));
+            }
+          }
+        enx = calloc(10, sizeof(char *));
+        xc = 0;
+        enx[xc++] = get_env(TERM);
+        enx[xc++] = get_env(PATH);
+        enx[xc++] = get_env("HOME");
+        edit_pid = fork();
+        errno = 0;
+        if (edit_pid != 0)
+        {
+          /*
+             This is to restart waitpid() after SIGCHLD signal is
+             generated (this happens when user presses Ctrl-G in
+             Emacs). Perhaps we should just block the signal
+             here. Also, you would expect that SA_RESTART would
+             achieve this, but couldn't get it to work. Anyways,
+             this is simple and it works.
+             */
+          done = 0;
+          while (done == 0)
+          {
+            pid = waitpid(edit_pid, &child_stat, 0);
+            if ((pid == 0) || ((pid < 0) && (errno != EINTR)))
+              done = 1;
+          }
+        }
+        else 
+        { 
+          if (execve(path, xrgs, enx) < 0) 
+          {
+            str = malloc(100);
+            sprintf(str, "execve() failure; %s", path);
+            perror(str);
+            _exit(-1);
+          }
+        }
+        edit_pid = 0;
+        /*
+           Restore signal handling.
+           */
+        if (1 && !fname)
+        {
+          /*
+             Done editing. A single GET loads afiedt.buf into the SQL
+             buffer, replacing what was there, and lists it. The file
+             minus its trailing '/' becomes the local copy of the buffer.
+             */
+          afiedt = read_file(AFIEDT, line);
+          if (afiedt != (char *) 0)
+          {
+            write(fdout, GET_CMD, strlen(GET_CMD));
+            prompt = get_sqlplus(fdin, line, (char **) 0);
+            free(prompt);
+            len = strlen(afiedt);
+            if ((len >= 3) && !strcmp(&(afiedt[len-3]), "\n/\n"))
+              len -= 3;
+            while ((len > 0) && isspace((int) afiedt[len-1]))
+              len--;
+            afiedt[len] = '\0';
+            free(sql_buffer);
+            sql_buffer = afiedt;
+            if (!len || (afiedt[len-1] == ';'))
+              sql_buffer = sfree(sql_buffer);
+          }
+          else
+            status = -1;
+        }
+      }
+      else
+        fprintf(stderr, "%s", AFIEDT_ERRMSG);
+      free_nta(enx);
+      free_nta(xrgs);
+    }
+    else
+    {
+      fprintf(stderr, "%s", AFIEDT_ERRMSG);
+      status = -1;
+    }
+  }
+  else
+    write(STDOUT_FILENO, NOTHING_TO_SAVE, strlen(NOTHING_TO_SAVE));
+  free(rname);
+  return status;
+}
+
+FILE *open_log_file()
+{
+  char *fname; 
+  FILE *fptr = (FILE *) 0;
+
+  fname = malloc(100*sizeof(char));
+  sprintf(fname, "gqlplus_%d.log", (int) getpid());
+  fptr = fopen(fname, "w");
+  free(fname);
+  return fptr;
+}
+
+struct table 
+{
+  char  *name;
+  char  *owner;
+  char  **columns;
+  long long num_rows; /* optimizer statistics, -1 if none */
+  long long blocks;
+};
+
+static struct table *tables;
+
+/*
+   Parse column names from output of 'DESCRIBE' Oracle command.
+   */
+static char **parse_columns(char *str)
+{
+  int  i;
+  int  j;
+  int  cflag;
+  int  capacity;
+  int  clen;
+  int  idx;
+  char *cname;
+  char **columns;
+  char **tokens;
+
+  capacity = INIT_NUM_COLUMNS;
+  columns = calloc(capacity+1, sizeof(char *)); 
+  tokens = str_tokenize(str, "\n");
+  idx = 1;
+  i = 0;
+  cflag = 0;
+  while ((cname = tokens[idx]))
+  {
+    idx++;
+    if (cflag == 0)
+    {
+      if (*cname && strstr(cname, "------"))
+        cflag = 1;
+    }
+    else
+    {
+      clen = strspn(cname, SPACETAB);
+      cname += clen;
+      clen = strcspn(cname, SPACETAB);
+      columns[i] = malloc((clen+1)*sizeof(char));
+      memcpy(columns[i], cname, clen);
+      (columns[i])[clen] = '\0';
+      tl2(columns[i]);
+      i++;
+      if (i >= capacity)
+      {
+        capacity += capacity;
+        columns = realloc(columns, (capacity+1)*sizeof(char *));
+        for (j = i; j <= capacity; j++)
+          columns[j] = (char *) 0;
+      }
+    }
+  }
+  return columns;
+}
+
+static char **get_column_names(char *tablename, char *owner, int fdin, int fdout, char *line)
+{
+  int  len;
+  char *ccmd = (char *) 0;
+  char *str = (char *) 0;
+  char *prompt = (char *) 0;
+  char **columns = (char **) 0;
+
+  if (tablename)
+  {
+    len = strlen(DESCRIBE)+strlen(tablename)+4;
+    if (owner)
+      len += strlen(owner);
+    ccmd = malloc(len*sizeof(char));
+    if (owner)
+      sprintf(ccmd, "%s %s.%s\n", DESCRIBE, owner, tablename);
+    else
+      sprintf(ccmd, "%s %s\n", DESCRIBE, tablename);
+    write(fdout, ccmd, strlen(ccmd));
+    prompt = get_sqlplus(fdin, line, &str);
+    free(prompt);
+    columns = parse_columns(str);
+    free(str);
+    free(ccmd);
+  }
+  return columns;
+}
+
+static int get_pagesize(int fdin, int fdout, char *line)
+{
+  int  pagesize;
+  int  len;
+  char *str;
+  char *xtr;
+
+  write(fdout, PAGESIZE_CMD, strlen(PAGESIZE_CMD));
+  get_sqlplus(fdin, line, &str);
+  xtr = strchr(str, ' ')+1;
+  len = strspn(xtr, DIGITS);
+  xtr[len] = '\0';
+  pagesize = atoi(xtr);
+  free(str);
+  return pagesize;
+}
+
+/*
+   Extract table names from 'str', where 'str' is the string
+   representation of the results of SELECT_TABLES query.
+
+   If 'complete_columns' is 1, get column names as well.
+   */
+static struct table *get_names(char *str, int fdin, int fdout, int pagesize, char *line)
+{
+  int  i;
+  int  j;
+  int  idx;
+  int  capacity;
+  char *tname;
+  char *ltr;
+  char **toks;
+  char **tokens;
+  struct table *tables = NULL;
+  FILE *fptr;
+
+  /*fptr = fopen("gqlplus.log", "a");*/
+  fptr = (FILE *) 0;
+  if (fptr)
+  {
+    fprintf(fptr, "str:`%s'\n", str);
+    fprintf(fptr, "pagesize: %d\n", pagesize);
+  }
+  capacity = INIT_NUM_TABLES;
+  tables = calloc(capacity+1, sizeof(struct table)); 
+  toks = str_tokenize(str, "\n");
+  idx = 0;
+  if (pagesize > 0)
+  {
+    idx = 1;
+    ltr = (char *) 0;
+  }
+  else
+    ltr = str;
+  i = 0;
+  while ((tname = toks[idx]))
+  {
+    idx++;
+    ltr = (char *) 0;
+    if (*tname && strcmp(tname, "TABLE_NAME") && strcmp(tname, "VIEW_NAME") &&
+        !strstr(tname, "------") && !strstr(tname, "rows selected"))
+    {
+      tokens = str_tokenize(tname, " \t");
+
+      if (fptr)
+      {
+        if (tname)
+          fprintf(fptr, "tname:\n%s\n", tname);
+        if (tokens[0])
+          fprintf(fptr, "tokens[0]: `%s'\n", tokens[0]);
+        if (tokens[1])
+          fprintf(fptr, "tokens[1]: `%s'\n", tokens[1]);
+      }
+
+      if (tokens[0])
+      {
+        tables[i].name = strdup(tokens[0]);
+        tl2(tables[i].name);
+      }
+      if (tokens[1])
+      {
+        tables[i].owner = strdup(tokens[1]);
+        tl2(tables[i].owner);
+      }
+      tables[i].num_rows = -1;
+      tables[i].blocks = -1;
+      str_free(tokens);
+      if (complete_columns == 1)
+        tables[i].columns = get_column_names(tables[i].name, tables[i].owner, 
+            fdin, fdout, line);
+      i++;
+    }
+    if (i >= capacity)
+    {
+      capacity += capacity;
+      tables = realloc(tables, (capacity+1)*sizeof(struct table));
+      for (j = i; j <= capacity; j++)
+      {
+        tables[j].name = (char *) 0;
+        tables[j].owner = (char *) 0;
+        tables[j].columns = (char **) 0;
+      }
+    }
+  }
+  if (fptr)
+    fclose(fptr);
+  return tables;
+}
+
+static int table_compare(const void *a, const void *b)
+{
+  int cmp;
+  const struct table *ta = a;
+  const struct table *tb = b;
+
+  cmp = strcmp(ta->name, tb->name);
+  if (cmp == 0)
+    cmp = strcmp(ta->owner ? ta->owner : "", tb->owner ? tb->owner : "");
+  return cmp;
+}
+
+/*
+   Index of the first entry named `name' in `tables', sorted by
+   get_table_stats(), or -1.
+   */
+static int find_table(struct table *tables, int ntables, const char *name)
+{
+  int lo;
+  int hi;
+  int mid;
+
+  lo = 0;
+  hi = ntables;
+  while (lo < hi)
+  {
+    mid = (lo+hi)/2;
+    if (strcmp(tables[mid].name, name) < 0)
+      lo = mid+1;
+    else
+      hi = mid;
+  }
+  if ((lo < ntables) && !strcmp(tables[lo].name, name))
+    return lo;
+  return -1;
+}
+
+/*
+   Sort `tables' by name and owner, and attach to them NUM_ROWS and
+   BLOCKS from `str', the output of the SELECT_STATS query.
+   */
+static void get_table_stats(struct table *tables, char *str)
+{
+  int  i;
+  int  j;
+  int  n;
+  char **toks;
+  char **tokens;
+
+  for (n = 0; tables[n].name; n++)
+    ;
+  qsort(tables, n, sizeof(struct table), table_compare);
+  if (!str || strstr(str, "ORA-"))
+    return;
+  toks = str_tokenize(str, "\n");
+  for (i = 0; toks[i]; i++)
+  {
+    tokens = str_tokenize(toks[i], " \t");
+    if (tokens[0] && tokens[1] && tokens[2] && tokens[3] && !tokens[4] &&
+        isdigit((int) *tokens[2]) && isdigit((int) *tokens[3]))
+    {
+      tl2(tokens[0]);
+      tl2(tokens[1]);
+      for (j = find_table(tables, n, tokens[0]);
+          (j >= 0) && (j < n) && !strcmp(tables[j].name, tokens[0]); j++)
+        if (tables[j].owner && !strcmp(tables[j].owner, tokens[1]))
+        {
+          tables[j].num_rows = atoll(tokens[2]);
+          tables[j].blocks = atoll(tokens[3]);
+          break;
+        }
+    }
+    str_free(tokens);
+  }
+  str_free(toks);
+}
+
+/*
+   Get the list of all tables and views for this user. If
+   'complete_columns' is 1, get all column names as well.
+   */
+static struct table *get_completion_names(int fdin, int fdout, char *line)
+{
+  int  pagesize;
+  char *str;
+  char *ccmd;
+  struct table *tables;
+
+  str = (char *) 0;
+  tables = (struct table *) 0;
+  pagesize = get_pagesize(fdin, fdout, line);
+  ccmd = malloc((strlen(SELECT_TABLES_1)+strlen(SELECT_TABLES_2)+1)*sizeof(char));
+  sprintf(ccmd, "%s%s", SELECT_TABLES_1, SELECT_TABLES_2);
+  write(fdout, ccmd, strlen(ccmd));
+  get_sqlplus(fdin, line, &str);
+  /* kehlet: ORA- error is likely because the database isn't open */
+  if (!strstr(str, "ORA-")) {
+    tables = get_names(str, fdin, fdout, pagesize, line);
+  }
+  free(str);
+  if (tables)
+  {
+    write(fdout, SELECT_STATS, strlen(SELECT_STATS));
+    get_sqlplus(fdin, line, &str);
+    get_table_stats(tables, str);
+    free(str);
+  }
+  write(fdout, DEL_CMD, strlen(DEL_CMD));
+  get_sqlplus(fdin, line, &str);
+  sql_buffer = sfree(sql_buffer);
+  free(ccmd);
+  return tables;
+}
+
+/*
+   Free what get_completion_names() returned.
+   */
+static void free_tables(struct table *tables)
+{
+  int  i;
+
+  if (!tables)
+    return;
+  for (i = 0; tables[i].name; i++)
+  {
+    free(tables[i].name);
+    free(tables[i].owner);
+    str_free(tables[i].columns);
+  }
+  free(tables);
+}
+
+
+/*
+   Next word of statement `*str', which may span lines; see
+   statement_word().
+   */
+static int next_statement_word(const char **str, char *word)
+{
+  const char *nl;
+
+  for (;;)
+  {
+    if (statement_word(str, word))
+    {
+      if (strcmp(word, "\n"))
+        return 1;
+    }
+    else if ((nl = strchr(*str, '\n')))
+      *str = nl+1;
+    else
+      return 0;
+  }
+}
+
+/*
+   Statistics of the biggest table a query reads, by the name `name'
+   it uses (`owner' may be empty). Without an owner, the table in the
+   connected schema wins, otherwise the biggest of that name.
+   */
+static struct table *scan_table(const char *owner, const char *name, struct table *best)
+{
+  int  j;
+  int  n;
+  int  ulen;
+  struct table *found;
+
+  for (n = 0; tables[n].name; n++)
+    ;
+  found = (struct table *) 0;
+  ulen = hist_ident ? strcspn(hist_ident, "@") : 0;
+  for (j = find_table(tables, n, name); (j >= 0) && (j < n) && !strcmp(tables[j].name, name); j++)
+  {
+    if (tables[j].num_rows < 0)
+      continue;
+    if (*owner)
+    {
+      if (tables[j].owner && !strcmp(tables[j].owner, owner))
+        found = &tables[j];
+    }
+    else if (tables[j].owner && ulen && ((int) strlen(tables[j].owner) == ulen) &&
+        !strncasecmp(tables[j].owner, hist_ident, ulen))
+    {
+      found = &tables[j];
+      break;
+    }
+    else if (!found || (tables[j].num_rows > found->num_rows))
+      found = &tables[j];
+  }
+  if (found && (!best || (found->num_rows > best->num_rows)))
+    return found;
+  return best;
+}
+
+/*
+   A SELECT without a WHERE clause or a row limit, about to be sent to
+   sqlplus, reads whole tables. If the optimizer statistics gathered by
+   get_completion_names() say one of them is bigger than the --!warn
+   threshold, say so and offer to add a FETCH FIRST clause to `rline'.
+   Returns `rline', or the statement that replaces it.
+   */
+static char *check_full_scan(char *rline)
+{
+  int  depth;
+  int  expect;
+  int  len;
+  int  tail;
+  long long rows;
+  char *answer;
+  char *fixed;
+  const char *ptr;
+  char word[STMT_WORD_LENGTH];
+  char owner[STMT_WORD_LENGTH];
+  char name[STMT_WORD_LENGTH];
+  struct table *big;
+  static const char *limiting[] =
+  {
+    "where", "fetch", "rownum", "offset", "group", "count", "sum", "min",
+    "max", "avg", (char *) 0
+  };
+  const char **kw;
+
+  if ((warn_rows <= 0) || !tables || !isatty(STDIN_FILENO))
+    return rline;
+  big = (struct table *) 0;
+  depth = 0;
+  expect = 0; /* 1: a table name, 2: '.' or an alias, 3: the name after '.', 4: ',' */
+  ptr = rline;
+  while (next_statement_word(&ptr, word))
+  {
+    for (kw = limiting; *kw && strcmp(*kw, word); kw++)
+      ;
+    if (*kw)
+      return rline;
+    if (!strcmp(word, "("))
+      depth++;
+    else if (!strcmp(word, ")"))
+      depth--;
+    if (depth > 0)
+      continue;
+    if (!strcmp(word, "from") || !strcmp(word, "join") || (!strcmp(word, ",") && expect))
+    {
+      if (expect == 2)
+        big = scan_table("", name, big);
+      expect = 1;
+    }
+    else if (expect == 1)
+    {
+      if (!isalpha((int) *word))
+        expect = 0;
+      else
+      {
+        strcpy(name, word);
+        expect = 2;
+      }
+    }
+    else if ((expect == 2) && !strcmp(word, "."))
+    {
+      strcpy(owner, name);
+      expect = 3;
+    }
+    else if (expect == 3)
+    {
+      if (isalpha((int) *word))
+        big = scan_table(owner, word, big);
+      expect = 4;
+    }
+    else if (expect == 2)
+    {
+      big = scan_table("", name, big);
+      expect = 4;
+    }
+    else
+      expect = 0;
+  }
+  if (expect == 2)
+    big = scan_table("", name, big);
+  if (!big || (big->num_rows < warn_rows))
+    return rline;
+  rows = (row_limit > 0) ? row_limit : WARN_FETCH;
+  printf("Warning: %s.%s has %lld rows (%lld blocks) and the query has no WHERE clause.\n",
+      big->owner ? big->owner : "", big->name, big->num_rows, big->blocks);
+  fflush(stdout);
+  suggest_active = 0;
+  fixed = malloc(100);
+  sprintf(fixed, "Add FETCH FIRST %lld ROWS ONLY? [y/n] ", rows);
+  answer = readline(fixed);
+  free(fixed);
+  if (!answer || ((*answer != 'y') && (*answer != 'Y')))
+  {
+    free(answer);
+    return rline;
+  }
+  free(answer);
+  /*
+     The clause goes before whatever ends the statement.
+     */
+  len = strlen(rline);
+  while ((len > 0) && isspace((int) rline[len-1]))
+    len--;
+  tail = len;
+  if ((len > 0) && (rline[len-1] == ';'))
+    len--;
+  else if ((len > 0) && (rline[len-1] == '/') && ((len == 1) || (rline[len-2] == '\n')))
+    len--;
+  while ((len > 0) && isspace((int) rline[len-1]))
+    len--;
+  fixed = malloc(strlen(rline)+100);
+  sprintf(fixed, "%.*s fetch first %lld rows only%s", len, rline, rows,
+      (tail > len) ? (rline[tail-1] == ';' ? ";" : "\n/") : "");
+  free(rline);
+  printf("%s\n", fixed);
+  return fixed;
+}
+
+/*
+   The --!warn command: show or set how many rows a table must have
+   for check_full_scan() to warn about a query reading all of it.
+   */
+static void set_warn(char *args)
+{
+  if (args)
+    args += strspn(args, WHITESPACE);
+  if (args && *args)
+  {
+    if (!strncmp(args, "off", 3))
+      warn_rows = 0;
+    else if (isdigit((int) *args))
+      warn_rows = atoll(args);
+    else
+    {
+      printf("Usage: %swarn [rows|off]\n", szCmdPrefix);
+      return;
+    }
+  }
+  if (warn_rows > 0)
+    printf("Queries reading all of a table of %lld rows or more need confirmation.\n", warn_rows);
+  else
+    printf("No warning about queries reading whole tables.\n");
+}
+
+/* 
+   Generator function for table/column name completion.  STATE lets us
+   know whether to start from scratch; without any state (i.e. STATE
+   == 0), then we start at the top of the list.
+   */
+char *tablecolumn_generator(const char *text, int state)
+{
+  static int table_index;
+  static int len;
+  static int column_index;
+  char *ltext;
+  char *name;
+  char *cname;
+
+  /* If this is a new word to complete, initialize now.  This includes
+     saving the length of TEXT for efficiency, and initializing the index
+     variable to 0. */
+  if (!state)
+  {
+    table_index = 0;
+    column_index = 0;
+    len = strlen (text);
+  }
+
+  ltext = lower_line(text);
+  /* Return the next name which partially matches from the command list. */
+  while ((name = tables[table_index].name))
+  {
+    table_index++;
+    if (strncmp(name, ltext, len) == 0)
+      return (strdup(name));
+    /*
+       Table name did not match. Try column names:
+       */
+    else if (complete_columns == 1)
+    {
+      while ((cname = tables[table_index-1].columns[column_index]))
+      {
+        column_index++;
+        if (strncmp(cname, ltext, len) == 0)
+        {
+          table_index--;
+          return (strdup(cname));
+        }
+      }
+      column_index = 0;
+    }
+  }
+
+  /* If no names matched, then return NULL. */
+  return ((char *) 0);
+}
+
+/*
+   --!watch seconds statement runs the statement on the current
+   session every so many seconds, in place, like watch -d. The first
+   result is drawn in full; after that only the lines that changed
+   since the run before are redrawn, highlighted. The output is hashed
+   line by line as it streams in and only what fits on the screen is
+   kept, so memory does not grow with the result. Any key, or Ctrl-C,
+   stops it.
+   */
+static void watch_statement(char *args, int fdin, int fdout, char *line)
+{
+  int    i;
+  int    n;
+  int    rows;
+  int    wait;
+  int    stop;
+  int    tty;
+  int    seen;
+  char   *stmt;
+  char   *ptr;
+  char   *header;
+  char   key;
+  char   stamp[32];
+  double seconds;
+  double start;
+  time_t t;
+  struct watcher w;
+  struct termios save;
+  struct termios raw;
+  struct pollfd pfd;
+
+  seconds = args ? strtod(args, &ptr) : 0;
+  if (args)
+    ptr += strspn(ptr, WHITESPACE);
+  if ((seconds <= 0) || !*ptr || (statement_kind(ptr) == STMT_PLSQL))
+  {
+    printf("Usage: %swatch seconds statement\n", szCmdPrefix);
+    return;
+  }
+  stmt = malloc(strlen(ptr)+3);
+  strcpy(stmt, ptr);
+  n = strlen(stmt);
+  if ((statement_kind(stmt) == STMT_SQL) && (stmt[n-1] != ';'))
+    stmt[n++] = ';';
+  stmt[n++] = '\n';
+  stmt[n] = '\0';
+  rl_get_screen_size(&rows, &w.cols);
+  if (w.cols <= 0)
+    w.cols = 80;
+  /*
+     The header on top, the "more lines" note at the bottom.
+     */
+  w.rows = (rows > WATCH_TOP) ? rows-WATCH_TOP : 1;
+  w.nprev = -1;
+  w.text = malloc(w.cols);
+  w.hashes = malloc(w.rows*sizeof(uint32_t));
+  w.hilite = calloc(w.rows, 1);
+  header = malloc(w.cols+1);
+  snprintf(header, w.cols+1, "Every %gs: %.*s", seconds, n-1, stmt);
+  /*
+     Keys are read as they are typed, and not echoed.
+     */
+  tty = !tcgetattr(STDIN_FILENO, &save);
+  if (tty)
+  {
+    raw = save;
+    raw.c_lflag &= ~(ICANON | ECHO);
+    raw.c_cc[VMIN] = 1;
+    raw.c_cc[VTIME] = 0;
+    tcsetattr(STDIN_FILENO, TCSANOW, &raw);
+  }
+  mirror_sql_buffer(stmt, 1);
+  seen = interrupts;
+  stop = 0;
+  while (!stop)
+  {
+    start = now();
+    t = time((time_t *) 0);
+    strftime(stamp, sizeof(stamp), "%H:%M:%S", localtime(&t));
+    if (w.nprev < 0)
+      printf("\033[H\033[2J");
+    printf("\033[1;1H%.*s\033[K\033[1;%dH%s", (int) (w.cols-strlen(stamp)-1), header,
+        (int) (w.cols-strlen(stamp)+1), stamp);
+    w.n = 0;
+    w.len = 0;
+    w.h = FNV_BASIS;
+    watching = &w;
+    sqlplus_busy = 1;
+    write(fdout, stmt, n);
+    free(get_sqlplus(fdin, line, (char **) 0));
+    sqlplus_busy = 0;
+    watching = (struct watcher *) 0;
+    if (quit_sqlplus || (interrupts != seen))
+      break;
+    if (w.len)
+      watch_end_line(&w);
+    for (i = w.n; i < w.nprev; i++)
+    {
+      w.hilite[i] = 0;
+      watch_line(i, "", 0, 0);
+    }
+    w.nprev = (w.n < w.rows) ? w.n : w.rows;
+    printf("\033[%d;1H", w.nprev+WATCH_TOP);
+    if (w.n > w.rows)
+      printf("(%d more lines)", w.n-w.rows);
+    printf("\033[K");
+    fflush(stdout);
+    /*
+       Wait for the next run, or for a key.
+       */
+    pfd.fd = STDIN_FILENO;
+    pfd.events = POLLIN;
+    while ((wait = (int) ((start+seconds-now())*1000)) > 0)
+    {
+      pfd.revents = 0;
+      if (poll(&pfd, 1, wait) > 0)
+      {
+        read(STDIN_FILENO, &key, 1);
+        stop = 1;
+        break;
+      }
+      if (interrupts != seen)
+      {
+        stop = 1;
+        break;
+      }
+    }
+  }
+  if (tty)
+    tcsetattr(STDIN_FILENO, TCSANOW, &save);
+  sqlplus_busy = 1;
+  printf("\n");
+  free(header);
+  free(w.hilite);
+  free(w.hashes);
+  free(w.text);
+  free(stmt);
+}
+
+/*
+   Detect gqlplus-specific commmand-line switch `sw'.
+   */
+static int gqlplus_switch(char **argv, char *sw)
+{
+  int i = 0;
+  int carg = 0;
+  int index = -1;
+
+  while (argv[i])
+  {
+    carg++;
+    if (!strcmp(argv[i], sw))
+      index = i;
+    i++;
+  }
+  if (index != -1)
+  {
+    for (i = index; i < carg; i++)
+      argv[i] = argv[i+1];
+    carg--;
+    argv[carg] = (char *) 0;
+  }
+  return carg;
+}
+
+/*
+   Detect gqlplus-specific command-line switch `sw' that takes a value,
+   and return the value. Both are removed from `argv'.
+   */
+static char *gqlplus_option(char **argv, char *sw)
+{
+  int  i;
+  char *value = (char *) 0;
+
+  for (i = 0; argv[i]; i++)
+    if (!strcmp(argv[i], sw) && argv[i+1])
+    {
+      value = argv[i+1];
+      for (; argv[i+2]; i++)
+        argv[i] = argv[i+2];
+      argv[i] = (char *) 0;
+      argv[i+1] = (char *) 0;
+      break;
+    }
+  return value;
+}
+
+static int install_completion(char *line, int *all_tables)
+{
+  int completion_names = 0;
+
+  rl_completion_entry_function = tablecolumn_generator;
+  if (progress == 1)
+  {
+    if (complete_columns == 1)
+      printf("gqlplus: scanning tables and columns...\n");
+    else
+      printf("gqlplus: scanning tables...\n");
+  }
+  tables = get_completion_names(fds2[0], fds1[1], line);
+  if (tables)
+    completion_names = 1;
+  else
+  {
+    /*
+       Something's wrong - we can't read or parse ALL_TABLES. Abandon
+       tablename completion. But warn the user.
+       */
+    fprintf(stderr, "Warning: couldn't query or parse ALL_TABLES or ALL_VIEWS. Tablename completion disabled.\n");
+    *all_tables = 0; 
+  }
+  return completion_names;
+}
+
+/*
+   Return the shell command (the argument of '!' or 'HO' SQLPLUS
+   commands).
+   */
+static char *get_shellcmd(char *lline)
+{
+  int  len;
+  char *shellcmd = (char *) 0;
+  char *xtr;
+
+  if (lline[0] == '!')
+  {
+    if (lline[1] == '\0')
+      shellcmd = getenv("SHELL");
+    else
+      shellcmd = &lline[1];
+  }
+  else if (!strncmp(lline, HOST_CMD, strlen(HOST_CMD)))
+  {
+    xtr = lline;
+    len = strcspn(lline, " ");
+    xtr += len;
+    len = strspn(xtr, " ");
+    xtr += len;
+    if (strlen(xtr) != 0)
+      shellcmd = xtr;
+    else
+      shellcmd = getenv("SHELL");
+  }
+  return shellcmd;
+}
+
+/*
+   Check if we have the complete connect string on the command line.
+   */
+static char *get_connect_string(int argc, char **argv)
+{
+  int  i;
+  int  done = 0;
+  char *str;
+  char *sid;
+  char *connect_string = (char *) 0;
+
+  sid = getenv(ORACLE_SID);
+  for (i = 1; (i < argc) && (done == 0); i++)
+  {
+    str = argv[i];
+    if ((str[0] != '-') && (str[0] != '@'))
+    {
+      if (strchr(str, '/'))
+      {
+        if (strchr(str, '@'))
+          connect_string = strdup(str);
+        else if (sid != (char *) 0)
+        {
+          connect_string = malloc(strlen(str)+strlen(sid)+2);
+          sprintf(connect_string, "%s@%s", str, sid);
+        }
+      }
+      else
+        username = strdup(str);
+    }
+  }
+  return connect_string;
+}
+
+/*
+   Build connect string from username, password, ORACLE_SID.
+   */
+static char *build_connect_string(char *user, char *password)
+{
+  char *connect_string = (char *) 0;
+  char *sid;
+  char **tokens;
+
+  sid = getenv(ORACLE_SID);
+  if (strchr(user, '@'))
+  {
+    if (strchr(user, '/'))
+      connect_string = strdup(user);
+    else if ((password != (char *) 0))
+    {
+      tokens = str_tokenize(user, "@");
+      connect_string = malloc(strlen(user)+strlen(password)+3);
+      sprintf(connect_string, "%s/%s@%s", tokens[0], password, tokens[1]);
+      str_free(tokens);
+    }
+  }
+  else if (password && (strchr(password, '@')))
+  {
+    connect_string = malloc(strlen(user)+strlen(password)+3);
+    sprintf(connect_string, "%s/%s", user, password);
+  }
+  else
+  {
+    if (sid != (char *) 0)
+    {
+      if (strchr(user, '/'))
+      {
+        connect_string = malloc(strlen(user)+strlen(sid)+2);
+        sprintf(connect_string, "%s@%s", user, sid);
+      }
+      else if (password != (char *) 0)
+      {
+        connect_string = malloc(strlen(user)+strlen(password)+strlen(sid)+3);
+        sprintf(connect_string, "%s/%s@%s", user, password, sid);
+      }
+    }
+  }
+  return connect_string;
+}
+
+/*
+   Call sqlplus to extract the initial sqlplus prompt. This is needed
+   in case a user has a (g)login.sql file which redefines the standard
+   prompt.
+   */
+static char *get_sql_prompt(char *old_prompt, char *sqlplus, char *connect_string, char *line, int *status)
+{
+  int  len;
+  char *sqlprompt = (char *) 0;
+  char *cmd;
+  char *xtr;
+  char *ptr;
+  char tmpdir[500]="";
+  char *env_tmpdir;
+  int  fd;
+
+  if (connect_string){
+    if (env_tmpdir=getenv("TMPDIR")){
+    }else if (env_tmpdir=getenv("TEMPDIR")){
+    }else{
+      env_tmpdir=getenv("TEMP");
+    }
+    if (env_tmpdir){
+      strcpy(tmpdir, env_tmpdir);
+    }else{
+      strcpy(tmpdir, "/tmp");
+    }
+    strcat(tmpdir, "/gqlplus.XXXXXX");
+    //printf("tmpdir: %s\n", tmpdir);
+    fd = mkstemp(tmpdir);
+    unlink(tmpdir);
+    if (fd < 0) {
+        fprintf(stderr, "%s: %s\n", tmpdir, strerror(errno));
+        close(fd);
+        return (NULL);
+    }
+    *status = 0;
+    /* still a lot todo */
+    cmd = malloc(strlen(GET_PROMPT)+strlen(TAIL_PROMPT)+strlen(sqlplus)+strlen(connect_string)+strlen(tmpdir)+20);
+    sprintf(cmd, "%s%s -s \"%s\" %s > %s", GET_PROMPT, sqlplus, connect_string, TAIL_PROMPT, tmpdir);
+    /*printf("cmd: `%s'\n", cmd);*/
+    *status = system(cmd);
+    if (!*status){
+      free(cmd);
+      xtr = read_file(tmpdir, line);
+      unlink(tmpdir);
+      
+         //Get the last line.
+      xtr = strstr(xtr, SQLPROMPT);
+      if (xtr){
+        if (!strcmp(xtr, "\n") || strncmp(xtr, SQLPROMPT, strlen(SQLPROMPT)))
+          sqlprompt = old_prompt;
+        else{
+            /*
+             Is this user using (g)login.sql? And if so, is she
+             setting sqlprompt?
+             */
+          ptr = strchr(xtr, '"');
+          ptr++;
+          len = strcspn(ptr, "\"");
+          sqlprompt = malloc(len+1);
+          memcpy(sqlprompt, ptr, len);
+          sqlprompt[len] = '\0';
         }
-      }else{
-        spath = sfree(spath);
       }
     }
   }
-  return spath;
+  return sqlprompt;
 }
 
-/*
-   Read 'fname' into string.
-   */
-static char *read_file(const char *fname, char *line)
+static void usage(int argc, char **argv)
 {
-  int  status;
-  int  len;
-  char *str = (char *) 0;
-  char *xtr;
-  struct stat buf;
-  FILE *fptr;
+  int i;
+  int done;
 
-  fptr = fopen(fname, "r");
-  if (fptr != (FILE *) 0){
-    status = stat(fname, &buf);
-    if (status == 0){
-      str = malloc((buf.st_size+1)*sizeof(char));
-      if (str != (char *) 0){
-        xtr = str;
-        while (fgets(line, MAX_LINE_LENGTH, fptr)){
-          len = strlen(line);
-          memcpy(xtr, line, len);
-          xtr += len;
-        }
-        fclose(fptr);
-        *xtr = '\0';
-      }
+  done = 0;
+  for (i = 0; (i < argc) && !done; i++)
+    if (!strcmp(argv[i], "-h"))
+    {
+      done = 1;
+      printf("\ngqlplus version %s; usage: gqlplus [sqlplus_options] [-h] [-d] [-p] [-ns] [-stop] [--parallel N] [--fanout targets -e statement] [--replay file]\n", VERSION);
+      printf("      \"-h\" this messsage\n");
+      printf("      \"-d\" disable column name completion\n");
+      printf("      \"-p\" show progress report and elapsed time\n");
+      printf("      \"-ns\" do not suggest statements from history as you type\n");
+      printf("      \"--parallel N\" user/password[@database] script.sql|manifest...: run the scripts, N at a time\n");
+      printf("      \"--fanout\" targets [--timeout seconds] -e statement: run the statement on every database in targets\n");
+      printf("      \"--replay\" file [--parallel N] [--speed X] user/password[@database]: replay a capture on N sessions\n");
+      printf("      \"-stop\" with input that is not a terminal, stop at the first ORA- or SP2- error\n");
+      printf("      SQL> %sr: rescan tables (for completion)\n", szCmdPrefix);
+      printf("      SQL> %sh: display command history\n", szCmdPrefix);
+      printf("      SQL> %smerge: merge history of other gqlplus sessions\n", szCmdPrefix);
+      printf("      SQL> %sslow [hours] [count]: slowest statements of the last hours\n", szCmdPrefix);
+      printf("      SQL> %stimeout [seconds|off]: interrupt statements running longer (default $GQLPLUS_TIMEOUT)\n", szCmdPrefix);
+      printf("      SQL> %slimit [rows [bytes]|off]: stop queries displaying more (default $GQLPLUS_LIMIT)\n", szCmdPrefix);
+      printf("      SQL> %smore: show the rows after those of a query that hit the limit\n", szCmdPrefix);
+      printf("      SQL> %swarn [rows|off]: confirm queries reading all of a bigger table (default $GQLPLUS_WARN_ROWS)\n", szCmdPrefix);
+      printf("      SQL> %snew [connect_string]: open another sqlplus session and make it current\n", szCmdPrefix);
+      printf("      SQL> %sswitch n: make session n current\n", szCmdPrefix);
+      printf("      SQL> %slist: list the open sessions\n", szCmdPrefix);
+      printf("      SQL> %sbg statement: run the statement on another session, in the background\n", szCmdPrefix);
+      printf("      SQL> %sjobs: list the background statements\n", szCmdPrefix);
+      printf("      SQL> %sexport [owner.]table [to dir] [parallel n]: unload a table as CSV, n ROWID ranges at a time\n", szCmdPrefix);
+      printf("      SQL> %swatch seconds statement: run the statement every so many seconds, highlighting changes\n", szCmdPrefix);
+      printf("      SQL> %scapture [file|off]: append the statements run, with their timing, to file\n", szCmdPrefix);
+      printf("To kill the program, use SIGQUIT (Ctrl-\\)\n");
     }
-  }
-  return str;
 }
 
-
 /*
-   Extract basename of 'path'. Like basename() (not available on all
-   platforms).
+   Return 1 if the line `str' of sqlplus output is an ORA- or SP2-
+   message, maybe behind the prompts sqlplus printed for the input
+   lines before it.
    */
-static char *bname(char *path)
+static int batch_error(const char *str)
 {
-  char *xtr;
-  char *bname = (char *) 0;
+  int len;
 
-  if (path && *path)
+  for (;;)
   {
-    xtr = strrchr(path, '/');
-    if (xtr)
-    {
-      xtr++;
-      bname = strdup(xtr);
-    }
+    if (!strncmp(str, SQL_PROMPT, strlen(SQL_PROMPT)))
+      str += strlen(SQL_PROMPT);
+    else if (sql_prompt && *sql_prompt && !strncmp(str, sql_prompt, strlen(sql_prompt)))
+      str += strlen(sql_prompt);
+    else if ((len = numeric_prompt_len(str)))
+      str += len;
     else
-      bname = strdup(path);
+      break;
   }
-  return bname;
+  return (!strncmp(str, "ORA-", 4) || !strncmp(str, "SP2-", 4)) && isdigit((int) str[4]);
 }
 
 /*
-   Extract EDITOR values from 'str'. 
+   Check the lines of sqlplus output `buf' (`len' bytes) as they are
+   completed; only their beginning matters. `last' holds the start of
+   the line in progress, `*llen' bytes of it. Returns the number of
+   ORA- and SP2- messages, or 1 at the first one with `first' set.
    */
-static char **set_editor(char *str)
+static int scan_errors(char *last, int *llen, const char *buf, int len, int first)
 {
-  char *ptr;
-  char *xtr;
-  char **editor = (char **) 0;
+  int  n;
+  int  errors = 0;
+  const char *ptr;
+  const char *eol;
 
-  if (str && *str && (ptr = strrchr(str, '=')))
+  for (ptr = buf; ptr < buf+len; ptr = eol+1)
   {
-    ptr++;
-    ptr += strspn(ptr, " \"");
-    xtr = strdup(ptr);
-    ptr = strrchr(xtr, ';');
-    if (ptr)
-      *ptr = '\0';
-    ptr = strrchr(xtr, '"');
-    if (ptr)
-      *ptr = '\0';
-    /*
-       We have the 'define _editor' string, now extract tokens.
-       */
-    editor = str_tokenize(xtr, " ");
-    /*
-       Remove end-of-line.
-       */
-    if ((ptr = strchr(editor[0], '\n')))
-      *ptr = '\0';
-    _editor = strdup(editor[0]);
-    if (*editor[0] != '/')
-      editor[0] = search_path(editor[0]);
-    free(xtr);
+    if (!(eol = memchr(ptr, '\n', buf+len-ptr)))
+      eol = buf+len;
+    n = eol-ptr;
+    if (n > BATCH_LINE-1-*llen)
+      n = BATCH_LINE-1-*llen;
+    memcpy(last+*llen, ptr, n);
+    *llen += n;
+    last[*llen] = '\0';
+    if (eol == buf+len)
+      break;
+    *llen = 0;
+    if (batch_error(last))
+    {
+      errors++;
+      if (first)
+        break;
+    }
   }
-  return editor;
-}
-
-/*
-   Check if file 'fptr' contains an editor definition line.
-   */
-static char **file_editor(FILE *fptr, char *line)
-{
-  char **editor = (char **) 0;
-
-  while (fgets(line, MAX_LINE_LENGTH, fptr) && (editor == (char **) 0))
-    if ((line[0] != '#') && strstr(line, DEFINE_CMD) && (strstr(line, EDITOR)))
-      editor = set_editor(line);
-  fclose(fptr);
-  return editor;
+  return errors;
 }
 
 /*
-   Extract EDITOR definition from glogin.sql and login.sql files.
-
-   sqlplus takes settings from glogin.sql in
-   ${ORACLE_HOME}/sqlplus/admin directory first. Then it looks for
-   login.sql file in the local directory, followed by directories in
-   ${SQLPATH}. Note that as soon as login.sql is found in any of these
-   directories, the search stops.
+   Batch mode, for input that is not a terminal: copy standard input to
+   sqlplus and sqlplus output to standard output, as they come and in
+   large pieces, without readline, history or prompt matching. Input is
+   only read when sqlplus has taken everything read before. With
+   `stop_on_error', sqlplus is told to exit on SQL errors and is
+   stopped at the first ORA- or SP2- message it prints. Closes `fdout'
+   and returns when sqlplus is done: 1 if it was stopped, 0 otherwise.
    */
-static char **file_set_editor(char *line)
+static int batch_sqlplus(int fdin, int fdout, int stop_on_error)
 {
-  int  found;
-  int  cntr;
-  char *path;
-  char **editor = (char **) 0;
-  char **sqlpath;
-  char *oracle_home;
-  FILE *fptr;
-
-  path = malloc(1024);
-  /*
-     Check local directory first.
-     */
-  found = 0;
-  strcpy(path, "login.sql");
-  fptr = fopen(path, "r");
-  if (fptr)
+  int    nfds;
+  int    eof;
+  int    len;
+  int    off;
+  int    nread;
+  int    flags;
+  int    llen;
+  char   *input;
+  char   *output;
+  char   last[BATCH_LINE];
+  struct pollfd pfd[3];
+
+  input = malloc(BATCH_CHUNK);
+  output = malloc(BATCH_CHUNK+1);
+  flags = fcntl(fdout, F_GETFL, 0);
+  fcntl(fdout, F_SETFL, flags | O_NONBLOCK);
+  len = 0;
+  off = 0;
+  eof = 0;
+  llen = 0;
+  sqlplus_busy = 1;
+  if (stop_on_error)
   {
-    found = 1;
-    editor = file_editor(fptr, line);
+    strcpy(input, BATCH_WHENEVER);
+    len = strlen(input);
   }
-  /*
-     If login.sql is not found in the local directory, check SQLPATH
-     directories.
-     */
-  sqlpath = str_tokenize(getenv("SQLPATH"), ":");
-  if (sqlpath)
+  for (;;)
   {
-    cntr = 0;
-    while (!found && sqlpath[cntr])
+    if (eof && (off == len) && (fdout >= 0))
     {
-      sprintf(path, "%s/login.sql", sqlpath[cntr]);
-      cntr++;
-      fptr = fopen(path, "r");
-      if (fptr)
+      /*
+         All input is with sqlplus; end of file tells it so.
+         */
+      close(fdout);
+      fdout = -1;
+    }
+    nfds = 0;
+    pfd[nfds].fd = fdin;
+    pfd[nfds++].events = POLLIN;
+    if (off < len)
+    {
+      pfd[nfds].fd = fdout;
+      pfd[nfds++].events = POLLOUT;
+    }
+    else if (!eof)
+    {
+      pfd[nfds].fd = STDIN_FILENO;
+      pfd[nfds++].events = POLLIN;
+    }
+    if (poll(pfd, nfds, -1) < 0)
+    {
+      if (errno == EINTR)
+        continue;
+      perror("batch_sqlplus()");
+      break;
+    }
+    if (pfd[0].revents)
+    {
+      nread = read(fdin, output, BATCH_CHUNK);
+      if (nread <= 0)
+        break; /* sqlplus is gone */
+      write(STDOUT_FILENO, output, nread);
+      if (stop_on_error && scan_errors(last, &llen, output, nread, 1))
       {
-        found = 1;
-        editor = file_editor(fptr, line);
+        fprintf(stderr, "gqlplus: stopping at the first error\n");
+        kill_sqlplus();
+        if (fdout >= 0)
+          close(fdout);
+        free(input);
+        free(output);
+        return 1;
       }
     }
-    str_free(sqlpath);
-  }
-  if (!found)
-  {
-    /*
-       login.sql not found. Check ${ORACLE_HOME}/sqlplus/admin/gqlplus.sql.
-       */
-    oracle_home = getenv("ORACLE_HOME");
-    if (oracle_home)
+    if ((nfds > 1) && (off < len) && pfd[1].revents)
     {
-      sprintf(path, "%s/sqlplus/admin/glogin.sql", oracle_home);
-      fptr = fopen(path, "r");
-      if (fptr)
+      nread = write(fdout, input+off, len-off);
+      if (nread > 0)
+        off += nread;
+      else if ((errno != EAGAIN) && (errno != EINTR))
+        break; /* sqlplus is gone */
+    }
+    else if ((nfds > 1) && pfd[1].revents)
+    {
+      nread = read(STDIN_FILENO, input, BATCH_CHUNK);
+      if (nread <= 0)
+        eof = 1;
+      else
       {
-        found = 1;
-        editor = file_editor(fptr, line);
+        off = 0;
+        len = nread;
       }
     }
   }
-  free(path);
-  return editor;
-}
-
-/*
-   Send 'xtr' to sqlplus using 'i' command.
-   */                        
-static void insert_line(int fdin, int fdout, char *xtr, char *ccmd, char *line)
-{
-  char *str;
-  char *prompt;
-
-  if (xtr && *xtr)
-  {
-    sprintf(ccmd, "i %s\n", xtr);
-    write(fdout, ccmd, strlen(ccmd));
-    prompt = get_sqlplus(fdin, line, &str);
-    free(prompt);
-    free(str);
-  }
-}
-
-static void free_nta(char **nta)
-{
-  int i;
-
-  if (nta != (char **) 0)
-  {
-    i = 0;
-    while (nta[i] != (char *) 0)
-      free(nta[i++]);
-    free(nta);
-  }
+  if (fdout >= 0)
+    close(fdout);
+  free(input);
+  free(output);
+  return 0;
 }
 
 /*
-   Implement 'PAUSE ON' mode. Requires special processing, since during
-   the dialogue with sqlplus no prompt is returned.
+   Quitting. Stop talking to sqlplus, show whatever it still has to
+   say, and wait for it to exit. Output is passed on as it arrives
+   until the pipe reaches end of file; a sqlplus that has not exited
+   after FINAL_WAIT ms is terminated. Returns the exit status of
+   sqlplus, which is also reported if it is not zero.
    */
-static void pause_cmd(int fdin, int fdout, char *line, char *sql_prompt, int first_flag)
+static int get_final_sqlplus(int fdin, int fdout)
 {
-  int  result;
-  int  done;
-  int  dn;
-  int  llen;
-  int  capacity;
-  int  flags;
-  int  process_response;
-  int  len;
-  char *lx;
-  char *response;
-  char *sp;
-  char *prompt;
-  char buffer[BUF_LEN];
+  int    result;
+  int    child_stat;
+  int    killed;
+  char   buffer[BUF_LEN];
+  pid_t  pid;
+  struct pollfd pfd;
 
   /*
-     Get sqlplus output without blocking.
-     */
-  flags = fcntl(fdin, F_GETFL, 0);
-  fcntl(fdin, F_SETFL, (flags | O_NDELAY));
-  /*
-     Send the command to sqlplus.
+     Nothing more will be sent; a sqlplus still waiting for input
+     sees end of file and exits.
      */
-  write(fdout, line, strlen(line));
-  write(fdout, "\n", 1);
-  if (first_flag)
-    process_response = 1;
-  else
-    process_response = 0;
-  lx = malloc((MAX_LINE_LENGTH+1)*sizeof(char));
-  response = malloc((INIT_LINE_LENGTH+1)*sizeof(char));
-  response[0] = '\0';
-  capacity = INIT_LINE_LENGTH;
-  llen = 0;
-  if (lx && response)
+  if (fdout >= 0)
+    close(fdout);
+  killed = 0;
+  pfd.fd = fdin;
+  pfd.events = POLLIN;
+  for (;;)
   {
-    done = 0;
-    while (!done)
+    pfd.revents = 0;
+    result = poll(&pfd, 1, FINAL_WAIT);
+    if (result == 0)
     {
-      /*
-         Read and display response.
-         */
-      dn = 0;
-      if (process_response)
-        while (!dn)
-        {
-          result = read(fdin, buffer, 1000);
-          if (result > 0)
-          {
-            if (result+llen > capacity)
-            {
-              while (capacity <= result+llen)
-                capacity += capacity;
-              response = realloc(response, capacity+1);
-            }
-            memcpy(&response[llen], buffer, result);
-            llen += result;
-            response[llen] = '\0';
-          }
-          /*
-             We should get out of the loop when sqlplus finishes
-             sending it's response. But there is really no
-             guaranteed way to know when sqlplus is done. So the
-             best thing we can do here is to wait for at least one
-             character; that means sqlplus has started sending, and
-             with the small usleep() delay below, it probably means
-             it will be done by the time we reach the next read()
-             above.
-
-             Again, this is not foolproof, but seems to work OK. If
-             problems are encountered, increase the usleep()
-             interval.
-             */
-          else if ((!result || ((result < 0) && (errno == EAGAIN))) && (llen > 0))
-            dn = 1;
-          else if ((result < 0) && (errno != EAGAIN))
-            perror(NULL);
-          usleep(1);
-        }
-      process_response = 1;
-      /*
-         Verify if the response ends in user-defined prompt or
-         default prompt. If so, terminate. Otherwise, display it.
-         */
-      if (sql_prompt)
-        prompt = sql_prompt;
-      else
-        prompt = SQL_PROMPT;
-      sp = strstr(response, prompt);
-      if (sp && (strlen(sp) == strlen(prompt)))
-      {
-        done = 1;
-        if (!first_flag)
-        {
-          len = sp-response;
-          fwrite(response, sizeof(char), len, stdout);
-          fflush(stdout);
-        }
-      }
-      else
-      {
-        printf("%s", response);
-        fflush(stdout);
-        response[0] = '\0';
-        llen = 0;
-        /*
-           Get a line from keyboard and send it to sqlplus.
-           */
-        fgets(lx, MAX_LINE_LENGTH, stdin);
-        write(fdout, lx, strlen(lx));
-      }
+      if (killed)
+        break;
+      kill_sqlplus();
+      killed = 1;
+      continue;
+    }
+    if (result > 0)
+      result = read(fdin, buffer, BUF_LEN);
+    if (result < 0)
+    {
+      if (errno == EINTR)
+        continue;
+      break;
     }
+    if (result == 0)
+      break;
+    fwrite(buffer, sizeof(char), result, stdout);
   }
-  else
-    perror(NULL);
-  /*
-     Reset pipe from sqlplus to O_NDELAY.
-     */
-  fcntl(fdin, F_SETFL, (flags &~ O_NDELAY));
-  free(lx);
-  free(response);
+  fflush(stdout);
+  close(fdin);
+  while (((pid = waitpid(sqlplus_pid, &child_stat, 0)) < 0) && (errno == EINTR))
+    ;
+  if (pid != sqlplus_pid)
+    return -1;
+  if (WIFSIGNALED(child_stat))
+  {
+    if (!sqlplus_killed)
+      fprintf(stderr, "sqlplus terminated by signal %d\n", WTERMSIG(child_stat));
+    return 128+WTERMSIG(child_stat);
+  }
+  if (WEXITSTATUS(child_stat))
+    fprintf(stderr, "sqlplus exited with status %d\n", WEXITSTATUS(child_stat));
+  return WEXITSTATUS(child_stat);
 }
 
 /*
-   Implement sqlplus 'edit' command. The command works in two modes:
-   first, if no 'fname' is given, it launches editing session of
-   afiedt.buf file, and sends the edited file to to sqlplus; if fname
-   is given, it opens it.
+   Start `spath' with arguments `xrgs' and environment `enx'. Its
+   standard input is read from pipe `ppipe' and its standard output
+   written to pipe `cpipe'; the parent keeps ppipe[1] to send
+   messages to sqlplus and cpipe[0] to receive them. Returns the pid
+   of the child, or -1.
    */
-static int edit(int fdin, int fdout, char *line, char **editor, char *fname)
+static pid_t spawn_sqlplus(char *spath, char **xrgs, char **enx, int *ppipe, int *cpipe)
 {
-  int   child_stat;
-  int   status;
-  int   i;
-  int   xc;
-  int   len;
-  int   done;
   pid_t pid;
-  char  *path;
-  char  *str;
-  char  *xtr;
-  char  *ptr;
-  char  *afiedt;
-  char  *prompt;
-  char  *ccmd;
-  char  *rname;
-  char  *newline;
-  char  **xrgs = (char **) 0;
-  char  **enx = (char **) 0;
-  FILE  *fptr;
+  char  *msg;
 
-  status = 0;
-  str = (char *) 0;
-  prompt = (char *) 0;
-  rname = (char *) 0;
-  if (fname)
+  pid = fork();
+  if (pid == 0)
   {
     /*
-       Optionally add .sql extension to fname.
+       Child.
        */
-    ptr = strstr(fname, SQLEXT);
-    if (ptr && (strlen(ptr) == strlen(SQLEXT)))
-      rname = strdup(fname);
-    else
+    if ((dup2(ppipe[0], STDIN_FILENO) == STDIN_FILENO) &&
+        (dup2(cpipe[1], STDOUT_FILENO) == STDOUT_FILENO))
     {
-      rname = malloc((strlen(fname)+strlen(SQLEXT)+1)*sizeof(char));
-      sprintf(rname, "%s%s", fname, SQLEXT);
+      /*
+         We have to disconnect sqlplus from controlling terminal.
+         Otherwise, keyboard special keys (interrupt, delete,
+         suspend) would go to sqlplus and disrupt it. See earlier
+         comments for sigint_handler().
+         */
+      setsid();
+      /*
+         Only the duplicates may stay open, or neither end would
+         ever see end of file.
+         */
+      close(ppipe[0]);
+      close(ppipe[1]);
+      close(cpipe[0]);
+      close(cpipe[1]);
+      execve(spath, xrgs, enx);
+      msg = malloc(strlen(spath)+100);
+      sprintf(msg, "execve() failure; %s", spath);
+      perror(msg);
     }
+    else
+      perror("Child dup2() error:");
+    _exit(1);
   }
-  else
+  close(ppipe[0]);
+  close(cpipe[1]);
+  if (pid > 0)
   {
-    /*
-       Get last SQL statement from sqlplus and put it in afiedt.buf, then
-       open it in editor.
-       */
-    write(fdout, LIST_CMD, strlen(LIST_CMD));
-    prompt = get_sqlplus(fdin, line, &str);
-    /* TBD: afiedt.buf filename hardcoded. */
-    rname = strdup(AFIEDT);
+    fcntl(ppipe[1], F_SETFD, FD_CLOEXEC);
+    fcntl(cpipe[0], F_SETFD, FD_CLOEXEC);
   }
-  if (fname || !strstr(str, NO_LINES))
+  return pid;
+}
+
+/*
+   Concurrent sqlplus sessions, see new_session(). The current one
+   lives in the usual globals (sqlplus_pid, fds1[1], fds2[0], state,
+   sql_prompt, tables, pause_mode and the --!limit settings); the
+   others are parked here with their completion index, so switching
+   does not cost a new login or a new table scan.
+   */
+struct session
+{
+  pid_t  pid;
+  int    fdin;              /* sqlplus output */
+  int    fdout;             /* sqlplus input */
+  int    state;
+  int    completion_names;
+  int    all_tables;
+  char   *connect_string;
+  char   *ident;            /* connect string without the password */
+  char   *sql_prompt;
+  char   *sql_buffer;
+  char   *output;           /* what it said while in the background */
+  int    olen;
+  struct table *tables;
+  int    pause_mode;
+  long long row_limit;
+  long long byte_limit;
+  char   *limit_stmt;
+  long long limit_offset;
+};
+
+static struct session *sessions = (struct session *) 0;
+static int nsessions = 0;    /* 0 until the first --!new */
+static int this_session = 0; /* index of the current session */
+
+static void park_session(struct session *s, char *connect_string, int completion_names, int all_tables)
+{
+  s->pid = sqlplus_pid;
+  s->fdin = fds2[0];
+  s->fdout = fds1[1];
+  s->state = state;
+  s->completion_names = completion_names;
+  s->all_tables = all_tables;
+  s->connect_string = connect_string;
+  free(s->ident);
+  s->ident = hist_ident ? strdup(hist_ident) : (char *) 0;
+  s->sql_prompt = sql_prompt;
+  s->sql_buffer = sql_buffer;
+  s->tables = tables;
+  s->pause_mode = pause_mode;
+  s->row_limit = row_limit;
+  s->byte_limit = byte_limit;
+  s->limit_stmt = limit_stmt;
+  s->limit_offset = limit_offset;
+}
+
+static char *load_session(struct session *s, int *completion_names, int *all_tables)
+{
+  sqlplus_pid = s->pid;
+  sqlplus_killed = 0;
+  fds2[0] = s->fdin;
+  fds1[1] = s->fdout;
+  state = s->state;
+  *completion_names = s->completion_names;
+  *all_tables = s->all_tables;
+  sql_prompt = s->sql_prompt;
+  sql_buffer = s->sql_buffer;
+  tables = s->tables;
+  pause_mode = s->pause_mode;
+  row_limit = s->row_limit;
+  byte_limit = s->byte_limit;
+  limit_stmt = s->limit_stmt;
+  limit_offset = s->limit_offset;
+  if (tables)
+    rl_completion_entry_function = tablecolumn_generator;
+  set_history_identity(s->connect_string);
+  if (s->olen)
   {
-    if (!fname)
-      fptr = fopen(rname, "w");
-    if (fptr || fname)
-    {
-      if (!fname)
-      {
-        /*
-           Have to clean-up the numeric prompt (5 characters) coming back
-           from the LIST_CMD.
-           */
-        xtr = str;
-        while ((ptr = strchr(xtr, '\n')) != (char *) 0)
-        {
-          len = ptr-xtr;
-          *ptr = '\0';
-          fprintf(fptr, "%s\n", xtr+5);
-          xtr += len+1;
-        }
-        fprintf(fptr, "/\n");
-        status = fclose(fptr);
-      }
-      if (!status)
-      {
-        free(str);
-        free(prompt);
-        path = editor[0];
-        xc = 0;
-        while (editor[xc++] != (char *) 0);
-        xrgs = calloc(xc+5, sizeof(char *));
-        xc = 0;
-        xrgs[xc++] = bname(path);
-        i = 1;
-        while (editor[i] != (char *) 0)
-        {
-          if ((newline = strchr(editor[i], '\n')))
-            *newline = '\0';
-          xrgs[xc++] = strdup(editor[i]);
-          i++;
-        }
-        xrgs[xc++] = strdup(rname);
-        /*
-           Launch emacs in a separate window.
-           */
-        if (!strcmp(xrgs[0], "emacs"))
-          if (!(xrgs[1] && !strcmp(xrgs[1], "-nw")))
-          {
-            if (getenv("DISPLAY"))
-            {
-              xrgs[xc++] = strdup("-d");
-              xrgs[xc++] = strdup(getenv("DISPLAY"));
-            }
-          }
-        enx = calloc(10, sizeof(char *));
-        xc = 0;
-        enx[xc++] = get_env(TERM);
-        enx[xc++] = get_env(PATH);
-        enx[xc++] = get_env("HOME");
-        edit_pid = fork();
-        errno = 0;
-        if (edit_pid != 0)
-        {
-          /*
-             This is to restart waitpid() after SIGCHLD signal is
-             generated (this happens when user presses Ctrl-G in
-             Emacs). Perhaps we should just block the signal
-             here. Also, you would expect that SA_RESTART would
-             achieve this, but couldn't get it to work. Anyways,
-             this is simple and it works.
-             */
-          done = 0;
-          while (done == 0)
-          {
-            pid = waitpid(edit_pid, &child_stat, 0);
-            if ((pid == 0) || ((pid < 0) && (errno != EINTR)))
-              done = 1;
-          }
-        }
-        else 
-        { 
-          if (execve(path, xrgs, enx) < 0) 
-          {
-            str = malloc(100);
-            sprintf(str, "execve() failure; %s", path);
-            perror(str);
-            _exit(-1);
-          }
-        }
-        edit_pid = 0;
-        /*
-           Restore signal handling.
-           */
-        if (1 && !fname)
-        {
-          /*
-             Done editing. Use 'del' and 'i' commands to send contents of
-             afiedt.buf to sqlplus. Algorithm: delete all lines in the
-             buffer using 'del 1 LAST' command, then send all lines from
-             'afiedt' to sqlplus using the 'i' command.
-             */
-          afiedt = read_file(AFIEDT, line);
-          if (afiedt != (char *) 0)
-          {
-            /*
-               Remove the trailing '/'.
-               */
-            len = strlen(afiedt);
-            if (!strcmp(&(afiedt[len-3]), "\n/\n"))
-            {
-              len -= 3;
-              afiedt[len] = '\0';
-            }
-            write(fdout, DEL_CMD, strlen(DEL_CMD));
-            prompt = get_sqlplus(fdin, line, &str);
-            free(prompt);
-            free(str);
-            xtr = afiedt;
-            ccmd = malloc(MAX_LINE_LENGTH*sizeof(char));
-            while ((ptr = strchr(xtr, '\n')) != (char *) 0)
-            {
-              len = ptr-xtr;
-              *ptr = '\0';
-              if (*xtr)
-              {
-                insert_line(fdin, fdout, xtr, ccmd, line);
-                xtr += len+1;
-              }
-            }
-            /*
-               Last line, if not empty.
-               */
-            insert_line(fdin, fdout, xtr, ccmd, line);
-            write(fdout, LIST_CMD, strlen(LIST_CMD));
-            prompt = get_sqlplus(fdin, line, (char **) 0);
-            free(prompt);
-            free(ccmd);
-            free(afiedt);
-          }
-          else
-            status = -1;
-        }
-      }
-      else
-        fprintf(stderr, "%s", AFIEDT_ERRMSG);
-      free_nta(enx);
-      free_nta(xrgs);
-    }
-    else
+    fwrite(s->output, sizeof(char), s->olen, stdout);
+    fflush(stdout);
+    s->olen = 0;
+  }
+  return s->connect_string;
+}
+
+/*
+   Read whatever the background sessions have to say, so that none of
+   them blocks on a full pipe. It is shown when the session becomes
+   current.
+   */
+static void drain_sessions(void)
+{
+  int    i;
+  int    nread;
+  struct session *s;
+  struct pollfd pfd;
+
+  for (i = 0; i < nsessions; i++)
+  {
+    s = &sessions[i];
+    if ((i == this_session) || (s->fdin < 0))
+      continue;
+    pfd.fd = s->fdin;
+    pfd.events = POLLIN;
+    while (poll(&pfd, 1, 0) > 0)
     {
-      fprintf(stderr, "%s", AFIEDT_ERRMSG);
-      status = -1;
+      s->output = realloc(s->output, s->olen+BUF_LEN);
+      nread = read(s->fdin, s->output+s->olen, BUF_LEN);
+      if (nread <= 0)
+        break;
+      s->olen += nread;
     }
   }
-  else
-    write(STDOUT_FILENO, NOTHING_TO_SAVE, strlen(NOTHING_TO_SAVE));
-  free(rname);
-  return status;
 }
 
-FILE *open_log_file()
+/*
+   Make session `n' (counting from 1) the current one.
+   */
+static int switch_session(int n, char **connect_string, int *completion_names, int *all_tables)
 {
-  char *fname; 
-  FILE *fptr = (FILE *) 0;
+  if ((n < 1) || (n > (nsessions ? nsessions : 1)))
+  {
+    printf("No session %d; see %slist.\n", n, szCmdPrefix);
+    return 0;
+  }
+  if (n-1 != this_session)
+  {
+    park_session(&sessions[this_session], *connect_string, *completion_names, *all_tables);
+    this_session = n-1;
+    *connect_string = load_session(&sessions[this_session], completion_names, all_tables);
+  }
+  return 1;
+}
 
-  fname = malloc(100*sizeof(char));
-  sprintf(fname, "gqlplus_%d.log", (int) getpid());
-  fptr = fopen(fname, "w");
-  free(fname);
-  return fptr;
+/*
+   Length of the time SET TIME ON puts in front of the prompt at the
+   start of `str', or 0.
+   */
+static int time_prefix_len(const char *str)
+{
+  if (isdigit((int) str[0]) && isdigit((int) str[1]) && (str[2] == ':') &&
+      isdigit((int) str[3]) && isdigit((int) str[4]) && (str[5] == ':') &&
+      isdigit((int) str[6]) && isdigit((int) str[7]) && isspace((int) str[8]))
+    return 9;
+  return 0;
 }
 
-struct table 
+/*
+   Length of `prompt', with or without the time in front of it, at the
+   start of `str', or 0.
+   */
+static int prompt_prefix_len(const char *str, const char *prompt)
 {
-  char  *name;
-  char  *owner;
-  char  **columns;
-};
+  int  skip;
 
-static struct table *tables;
+  if (!*prompt)
+    return 0;
+  skip = time_prefix_len(str);
+  if (strncmp(str+skip, prompt, strlen(prompt)))
+    return 0;
+  return skip+strlen(prompt);
+}
 
 /*
-   Parse column names from output of 'DESCRIBE' Oracle command.
+   Log the sqlplus started with /nolog on `fdin' and `fdout' in as
+   `cstr', down the pipe where ps does not show the password. sqlplus
+   prints a mark before and after the login, so what it prompts with
+   before the first is its prompt without a connection, and after the
+   second the prompt of the session, which (g)login.sql may have made
+   per user or per database. Its banner and what the login said are
+   shown without those prompts. Returns the session's prompt, or null
+   if it cannot be told; quit_sqlplus is set if sqlplus exited, as it
+   does when the login fails.
    */
-static char **parse_columns(char *str)
+static char *login_session(int fdin, int fdout, char *cstr)
 {
-  int  i;
-  int  j;
-  int  cflag;
-  int  capacity;
-  int  clen;
-  int  idx;
-  char *cname;
-  char **columns;
-  char **tokens;
-
-  capacity = INIT_NUM_COLUMNS;
-  columns = calloc(capacity+1, sizeof(char *)); 
-  tokens = str_tokenize(str, "\n");
-  idx = 1;
-  i = 0;
-  cflag = 0;
-  while ((cname = tokens[idx]))
+  int    len;
+  int    nread;
+  int    capacity;
+  int    skip;
+  int    eof;
+  char   *buffer;
+  char   *login;
+  char   *mark;
+  char   *nolog;
+  char   *prompt;
+  char   *ptr;
+  char   *eol;
+  struct pollfd pfd;
+
+  login = malloc(strlen(SESSION_LOGIN)+strlen(cstr));
+  sprintf(login, SESSION_LOGIN, cstr);
+  write(fdout, login, strlen(login));
+  free(login);
+  capacity = pipe_size;
+  buffer = malloc((capacity+1)*sizeof(char));
+  buffer[0] = '\0';
+  len = 0;
+  eof = 0;
+  pfd.fd = fdin;
+  pfd.events = POLLIN;
+  /*
+     The prompt after the second mark may come in pieces; it is
+     complete once sqlplus has been quiet for a moment.
+     */
+  while (!(mark = strstr(buffer, SESSION_MARK "2\n")) ||
+      !mark[strlen(SESSION_MARK "2\n")] || (poll(&pfd, 1, 200) > 0))
   {
-    idx++;
-    if (cflag == 0)
+    if (len+pipe_size > capacity)
     {
-      if (*cname && strstr(cname, "------"))
-        cflag = 1;
+      while (len+pipe_size > capacity)
+        capacity += capacity;
+      buffer = realloc(buffer, capacity+1);
     }
-    else
+    nread = read(fdin, &buffer[len], pipe_size);
+    if ((nread < 0) && (errno == EINTR))
+      continue;
+    if (nread <= 0)
     {
-      clen = strspn(cname, SPACETAB);
-      cname += clen;
-      clen = strcspn(cname, SPACETAB);
-      columns[i] = malloc((clen+1)*sizeof(char));
-      memcpy(columns[i], cname, clen);
-      (columns[i])[clen] = '\0';
-      tl2(columns[i]);
-      i++;
-      if (i >= capacity)
-      {
-        capacity += capacity;
-        columns = realloc(columns, (capacity+1)*sizeof(char *));
-        for (j = i; j <= capacity; j++)
-          columns[j] = (char *) 0;
-      }
+      eof = 1;
+      quit_sqlplus = 1;
+      break;
     }
+    len += nread;
+    buffer[len] = '\0';
   }
-  return columns;
+  prompt = (char *) 0;
+  if (!eof)
+  {
+    ptr = mark+strlen(SESSION_MARK "2\n");
+    ptr += time_prefix_len(ptr);
+    if (*ptr)
+      prompt = strdup(ptr);
+    *mark = '\0';
+  }
+  nolog = "";
+  ptr = buffer;
+  if ((mark = strstr(buffer, SESSION_MARK "1\n")))
+  {
+    *mark = '\0';
+    nolog = (eol = strrchr(buffer, '\n')) ? eol+1 : buffer;
+    fwrite(buffer, sizeof(char), nolog-buffer, stdout);
+    nolog += time_prefix_len(nolog);
+    ptr = mark+strlen(SESSION_MARK "1\n");
+  }
+  while (*ptr)
+  {
+    while ((skip = prompt_prefix_len(ptr, nolog)) ||
+        (prompt && (skip = prompt_prefix_len(ptr, prompt))))
+      ptr += skip;
+    len = (eol = strchr(ptr, '\n')) ? eol+1-ptr : (int) strlen(ptr);
+    fwrite(ptr, sizeof(char), len, stdout);
+    ptr += len;
+  }
+  fflush(stdout);
+  free(buffer);
+  return prompt;
 }
 
-static char **get_column_names(char *tablename, char *owner, int fdin, int fdout, char *line)
+/*
+   Start another sqlplus, connected as `args' or, without it, like the
+   current session, and make it current. Its banner is shown here; a
+   session whose login fails is dropped. If its prompt cannot be told,
+   it takes over that of the current session, which reads the same
+   (g)login.sql. It starts with PAUSE off and the limits of
+   GQLPLUS_LIMIT, as sqlplus and gqlplus do.
+   */
+static void new_session(char *args, char *spath, char **enx,
+    char **connect_string, int *completion_names, int *all_tables)
 {
-  int  len;
-  char *ccmd = (char *) 0;
-  char *str = (char *) 0;
-  char *prompt = (char *) 0;
-  char **columns = (char **) 0;
-
-  if (tablename)
+  int    ppipe[2];
+  int    cpipe[2];
+  int    previous;
+  char   *cstr;
+  char   *xrgs[3];
+  char   *ptr;
+  pid_t  pid;
+  struct session *s;
+
+  if (args)
+    cstr = strdup(args);
+  else if (*connect_string)
+    cstr = strdup(*connect_string);
+  else
   {
-    len = strlen(DESCRIBE)+strlen(tablename)+4;
-    if (owner)
-      len += strlen(owner);
-    ccmd = malloc(len*sizeof(char));
-    if (owner)
-      sprintf(ccmd, "%s %s.%s\n", DESCRIBE, owner, tablename);
-    else
-      sprintf(ccmd, "%s %s\n", DESCRIBE, tablename);
-    write(fdout, ccmd, strlen(ccmd));
-    prompt = get_sqlplus(fdin, line, &str);
-    free(prompt);
-    columns = parse_columns(str);
-    free(str);
-    free(ccmd);
+    printf("Usage: %snew connect_string\n", szCmdPrefix);
+    return;
+  }
+  if (pipe(ppipe) < 0)
+  {
+    perror((char *) 0);
+    free(cstr);
+    return;
+  }
+  if (pipe(cpipe) < 0)
+  {
+    perror((char *) 0);
+    close(ppipe[0]);
+    close(ppipe[1]);
+    free(cstr);
+    return;
+  }
+  xrgs[0] = spath;
+  xrgs[1] = "/nolog";
+  xrgs[2] = (char *) 0;
+  pid = spawn_sqlplus(spath, xrgs, enx, ppipe, cpipe);
+  if (pid < 0)
+  {
+    perror((char *) 0);
+    close(ppipe[1]);
+    close(cpipe[0]);
+    free(cstr);
+    return;
+  }
+  if (!nsessions)
+  {
+    sessions = calloc(1, sizeof(struct session));
+    nsessions = 1;
+    this_session = 0;
+  }
+  sessions = realloc(sessions, (nsessions+1)*sizeof(struct session));
+  park_session(&sessions[this_session], *connect_string, *completion_names, *all_tables);
+  previous = this_session;
+  this_session = nsessions++;
+  s = &sessions[this_session];
+  memset(s, 0, sizeof(struct session));
+  s->pid = pid;
+  s->fdin = cpipe[0];
+  s->fdout = ppipe[1];
+  s->state = STARTUP;
+  s->all_tables = 1;
+  s->connect_string = cstr;
+  if ((ptr = getenv("GQLPLUS_LIMIT")))
+    s->row_limit = atoll(ptr);
+  printf("Session %d:\n", this_session+1);
+  fflush(stdout);
+  s->sql_prompt = login_session(s->fdin, s->fdout, cstr);
+  if (!s->sql_prompt)
+    s->sql_prompt = sessions[previous].sql_prompt;
+  *connect_string = load_session(s, completion_names, all_tables);
+  if (quit_sqlplus)
+  {
+    quit_sqlplus = 0;
+    get_final_sqlplus(fds2[0], fds1[1]);
+    free(cstr);
+    nsessions--;
+    this_session = previous;
+    *connect_string = load_session(&sessions[this_session], completion_names, all_tables);
+    printf("\nSession not opened; session %d is current.\n", this_session+1);
   }
-  return columns;
 }
 
-static int get_pagesize(int fdin, int fdout, char *line)
+/*
+   The current session has quit while others are still open: drop it
+   and go back to the first of the others. Returns the new prompt.
+   */
+static char *close_session(char *line, char **connect_string, int *completion_names, int *all_tables)
 {
-  int  pagesize;
-  int  len;
-  char *str;
-  char *xtr;
-
-  write(fdout, PAGESIZE_CMD, strlen(PAGESIZE_CMD));
-  get_sqlplus(fdin, line, &str);
-  xtr = strchr(str, ' ')+1;
-  len = strspn(xtr, DIGITS);
-  xtr[len] = '\0';
-  pagesize = atoi(xtr);
-  free(str);
-  return pagesize;
+  get_final_sqlplus(fds2[0], fds1[1]);
+  free(sessions[this_session].ident);
+  free(sessions[this_session].output);
+  free(limit_stmt);
+  free(sql_buffer);
+  free_tables(tables);
+  free(*connect_string);
+  memmove(&sessions[this_session], &sessions[this_session+1],
+      (nsessions-this_session-1)*sizeof(struct session));
+  nsessions--;
+  this_session = 0;
+  *connect_string = load_session(&sessions[this_session], completion_names, all_tables);
+  quit_sqlplus = 0;
+  printf("Session %d is current.\n", this_session+1);
+  write(fds1[1], "\n", 1);
+  return get_sqlplus(fds2[0], line, (char **) 0);
 }
 
 /*
-   Extract table names from 'str', where 'str' is the string
-   representation of the results of SELECT_TABLES query.
-
-   If 'complete_columns' is 1, get column names as well.
+   Quitting: the background sessions get end of file too.
    */
-static struct table *get_names(char *str, int fdin, int fdout, int pagesize, char *line)
+static void end_sessions(void)
 {
-  int  i;
-  int  j;
-  int  idx;
-  int  capacity;
-  char *tname;
-  char *ltr;
-  char **toks;
-  char **tokens;
-  struct table *tables = NULL;
-  FILE *fptr;
+  int    i;
+  struct session *s;
 
-  /*fptr = fopen("gqlplus.log", "a");*/
-  fptr = (FILE *) 0;
-  if (fptr)
+  for (i = 0; i < nsessions; i++)
   {
-    fprintf(fptr, "str:`%s'\n", str);
-    fprintf(fptr, "pagesize: %d\n", pagesize);
+    s = &sessions[i];
+    if (i == this_session)
+      continue;
+    sqlplus_pid = s->pid;
+    sqlplus_killed = 0;
+    if (s->olen)
+      fwrite(s->output, sizeof(char), s->olen, stdout);
+    get_final_sqlplus(s->fdin, s->fdout);
   }
-  capacity = INIT_NUM_TABLES;
-  tables = calloc(capacity+1, sizeof(struct table)); 
-  toks = str_tokenize(str, "\n");
-  idx = 0;
-  if (pagesize > 0)
+}
+
+static void list_sessions(void)
+{
+  int    i;
+  struct session *s;
+
+  if (!nsessions)
   {
-    idx = 1;
-    ltr = (char *) 0;
+    printf("*  1  %s (pid %d)\n", hist_ident ? hist_ident : "", (int) sqlplus_pid);
+    return;
   }
-  else
-    ltr = str;
-  i = 0;
-  while ((tname = toks[idx]))
+  for (i = 0; i < nsessions; i++)
   {
-    idx++;
-    ltr = (char *) 0;
-    if (*tname && strcmp(tname, "TABLE_NAME") && strcmp(tname, "VIEW_NAME") &&
-        !strstr(tname, "------") && !strstr(tname, "rows selected"))
-    {
-      tokens = str_tokenize(tname, " \t");
-
-      if (fptr)
-      {
-        if (tname)
-          fprintf(fptr, "tname:\n%s\n", tname);
-        if (tokens[0])
-          fprintf(fptr, "tokens[0]: `%s'\n", tokens[0]);
-        if (tokens[1])
-          fprintf(fptr, "tokens[1]: `%s'\n", tokens[1]);
-      }
-
-      if (tokens[0])
-      {
-        tables[i].name = strdup(tokens[0]);
-        tl2(tables[i].name);
-      }
-      if (tokens[1])
-      {
-        tables[i].owner = strdup(tokens[1]);
-        tl2(tables[i].owner);
-      }
-      str_free(tokens);
-      if (complete_columns == 1)
-        tables[i].columns = get_column_names(tables[i].name, tables[i].owner, 
-            fdin, fdout, line);
-      i++;
-    }
-    if (i >= capacity)
-    {
-      capacity += capacity;
-      tables = realloc(tables, (capacity+1)*sizeof(struct table));
-      for (j = i; j <= capacity; j++)
-      {
-        tables[j].name = (char *) 0;
-        tables[j].owner = (char *) 0;
-        tables[j].columns = (char **) 0;
-      }
-    }
+    s = &sessions[i];
+    if (i == this_session)
+      printf("*%3d  %s (pid %d)\n", i+1, hist_ident ? hist_ident : "", (int) sqlplus_pid);
+    else
+      printf(" %3d  %s (pid %d)%s\n", i+1, s->ident ? s->ident : "", (int) s->pid,
+          s->olen ? ", output waiting" : "");
   }
-  if (fptr)
-    fclose(fptr);
-  return tables;
 }
 
 /*
-   Get the list of all tables and views for this user. If
-   'complete_columns' is 1, get all column names as well.
+   Statements run in the background by --!bg, each on a sqlplus of its
+   own that writes to a file and exits when the statement is done.
    */
-static struct table *get_completion_names(int fdin, int fdout, char *line)
+struct job
 {
-  int  pagesize;
-  char *str;
-  char *ccmd;
-  struct table *tables;
+  pid_t  pid;
+  char   *stmt;
+  char   *fname;               /* where its output goes */
+  double start;
+  double end;                  /* 0 while it runs */
+  int    status;               /* exit status of sqlplus */
+};
 
-  str = (char *) 0;
-  tables = (struct table *) 0;
-  pagesize = get_pagesize(fdin, fdout, line);
-  ccmd = malloc((strlen(SELECT_TABLES_1)+strlen(SELECT_TABLES_2)+1)*sizeof(char));
-  sprintf(ccmd, "%s%s", SELECT_TABLES_1, SELECT_TABLES_2);
-  write(fdout, ccmd, strlen(ccmd));
-  get_sqlplus(fdin, line, &str);
-  /* kehlet: ORA- error is likely because the database isn't open */
-  if (!strstr(str, "ORA-")) {
-    tables = get_names(str, fdin, fdout, pagesize, line);
-  }
-  free(str);
-  write(fdout, DEL_CMD, strlen(DEL_CMD));
-  get_sqlplus(fdin, line, &str);
-  free(ccmd);
-  return tables;
-}
+static struct job *jobs = (struct job *) 0;
+static int njobs = 0;
 
+/*
+   Input for a sqlplus of its own that is to run `stmt' and exit:
+   `settings', then WHENEVER SQLERROR so that a failure shows in the
+   exit status, then the statement with the terminator it may lack.
+   */
+static char *statement_input(const char *settings, const char *stmt)
+{
+  int    kind;
+  char   *input;
+
+  kind = statement_kind(stmt);
+  input = malloc(strlen(settings)+strlen(BATCH_WHENEVER)+strlen(stmt)+20);
+  sprintf(input, "%s%s%s%s\nexit\n", settings, BATCH_WHENEVER, stmt,
+      (kind == STMT_PLSQL) ? "\n/" :
+      ((kind == STMT_SQL) && !statement_ends(stmt, kind)) ? ";" : "");
+  return input;
+}
 
-/* 
-   Generator function for table/column name completion.  STATE lets us
-   know whether to start from scratch; without any state (i.e. STATE
-   == 0), then we start at the top of the list.
+/*
+   Create a file in $TMPDIR (or $TEMPDIR, $TEMP, /tmp) that nobody
+   else can have made or can read, named after `tag'. Returns its
+   descriptor and sets `*fname', or returns -1.
    */
-char *tablecolumn_generator(const char *text, int state)
+static int temp_file(const char *tag, char **fname)
 {
-  static int table_index;
-  static int len;
-  static int column_index;
-  char *ltext;
-  char *name;
-  char *cname;
+  int    fd;
+  char   *tmpdir;
 
-  /* If this is a new word to complete, initialize now.  This includes
-     saving the length of TEXT for efficiency, and initializing the index
-     variable to 0. */
-  if (!state)
+  if (!(tmpdir = getenv("TMPDIR")) && !(tmpdir = getenv("TEMPDIR")) && !(tmpdir = getenv("TEMP")))
+    tmpdir = "/tmp";
+  *fname = malloc(strlen(tmpdir)+strlen(tag)+40);
+  sprintf(*fname, "%s/gqlplus.%d.%s.XXXXXX", tmpdir, (int) getpid(), tag);
+  if ((fd = mkstemp(*fname)) < 0)
   {
-    table_index = 0;
-    column_index = 0;
-    len = strlen (text);
+    perror(*fname);
+    *fname = sfree(*fname);
   }
+  return fd;
+}
 
-  ltext = tl((char *) text);
-  /* Return the next name which partially matches from the command list. */
-  while ((name = tables[table_index].name))
+/*
+   Run `args' on another sqlplus connected as `connect_string'.
+   */
+static void bg_statement(char *args, char *spath, char **enx, char *connect_string)
+{
+  int    ppipe[2];
+  int    cpipe[2];
+  char   tag[20];
+  char   *fname;
+  char   *input;
+  char   *login;
+  char   *xrgs[4];
+  pid_t  pid;
+  struct job *j;
+
+  if (!args)
   {
-    table_index++;
-    if (strncmp(name, ltext, len) == 0)
-    {
-      free(ltext);
-      return (strdup(name));
-    }
-    /*
-       Table name did not match. Try column names:
-       */
-    else if (complete_columns == 1)
-    {
-      while ((cname = tables[table_index-1].columns[column_index]))
-      {
-        column_index++;
-        if (strncmp(cname, ltext, len) == 0)
-        {
-          table_index--;
-          free(ltext);
-          return (strdup(cname));
-        }
-      }
-      column_index = 0;
-    }
+    printf("Usage: %sbg statement\n", szCmdPrefix);
+    return;
+  }
+  if (!connect_string)
+  {
+    printf("Not connected; %sbg needs a connect string.\n", szCmdPrefix);
+    return;
+  }
+  sprintf(tag, "bg%d", njobs+1);
+  cpipe[0] = -1;
+  if ((cpipe[1] = temp_file(tag, &fname)) < 0)
+    return;
+  if (pipe(ppipe) < 0)
+  {
+    perror((char *) 0);
+    close(cpipe[1]);
+    free(fname);
+    return;
+  }
+  /*
+     The connect string goes down the pipe, as in start_task().
+     */
+  xrgs[0] = spath;
+  xrgs[1] = "-s";
+  xrgs[2] = "/nolog";
+  xrgs[3] = (char *) 0;
+  pid = spawn_sqlplus(spath, xrgs, enx, ppipe, cpipe);
+  if (pid < 0)
+  {
+    perror((char *) 0);
+    close(ppipe[1]);
+    free(fname);
+    return;
   }
-  free(ltext);
+  login = malloc(strlen(TASK_CONNECT)+strlen(connect_string));
+  sprintf(login, TASK_CONNECT, connect_string);
+  write(ppipe[1], login, strlen(login));
+  free(login);
+  input = statement_input("", args);
+  write(ppipe[1], input, strlen(input));
+  close(ppipe[1]);
+  free(input);
+  jobs = realloc(jobs, (njobs+1)*sizeof(struct job));
+  j = &jobs[njobs++];
+  j->pid = pid;
+  j->stmt = strdup(args);
+  j->fname = fname;
+  j->start = now();
+  j->end = 0;
+  j->status = 0;
+  printf("[%d] %d, output to %s\n", njobs, (int) pid, fname);
+}
 
-  /* If no names matched, then return NULL. */
-  return ((char *) 0);
+static long long job_bytes(struct job *j)
+{
+  struct stat st;
+
+  if (stat(j->fname, &st) < 0)
+    return -1;
+  return (long long) st.st_size;
 }
 
 /*
-   Detect gqlplus-specific commmand-line switch `sw'.
+   Jobs are only reaped at the prompt, which may be long after they
+   finished; the time their output was last written tells better.
    */
-static int gqlplus_switch(char **argv, char *sw)
+static double job_end(struct job *j)
 {
-  int i = 0;
-  int carg = 0;
-  int index = -1;
+  double end;
+  struct stat st;
 
-  while (argv[i])
+  end = now();
+  if ((stat(j->fname, &st) == 0) && (st.st_mtime > j->start) && (st.st_mtime < end-1))
+    end = st.st_mtime;
+  return end;
+}
+
+/*
+   Reap the background statements that have finished and say so.
+   */
+static void check_jobs(void)
+{
+  int    i;
+  int    child_stat;
+  struct job *j;
+
+  for (i = 0; i < njobs; i++)
   {
-    carg++;
-    if (!strcmp(argv[i], sw))
-      index = i;
-    i++;
+    j = &jobs[i];
+    if (j->end || (waitpid(j->pid, &child_stat, WNOHANG) != j->pid))
+      continue;
+    j->end = job_end(j);
+    j->status = WIFEXITED(child_stat) ? WEXITSTATUS(child_stat) : 128+WTERMSIG(child_stat);
+    printf("[%d] %s after %.2f seconds, %lld bytes in %s\n", i+1,
+        j->status ? "Failed" : "Done", j->end-j->start, job_bytes(j), j->fname);
   }
-  if (index != -1)
+  fflush(stdout);
+}
+
+static void list_jobs(void)
+{
+  int    i;
+  struct job *j;
+
+  check_jobs();
+  for (i = 0; i < njobs; i++)
   {
-    for (i = index; i < carg; i++)
-      argv[i] = argv[i+1];
-    carg--;
-    argv[carg] = (char *) 0;
+    j = &jobs[i];
+    printf("[%d] %-8s %10.2f s %12lld bytes  %.50s\n", i+1,
+        !j->end ? "Running" : (j->status ? "Failed" : "Done"),
+        (j->end ? j->end : now())-j->start, job_bytes(j), j->stmt);
   }
-  return carg;
 }
 
-static int install_completion(char *line, int *all_tables)
+/*
+   Background statements are left to finish on their own.
+   */
+static void end_jobs(void)
 {
-  int completion_names = 0;
+  int    i;
 
-  rl_completion_entry_function = tablecolumn_generator;
-  if (progress == 1)
+  check_jobs();
+  for (i = 0; i < njobs; i++)
+    if (!jobs[i].end)
+      fprintf(stderr, "gqlplus: [%d] still running, output to %s\n", i+1, jobs[i].fname);
+}
+
+/*
+   A script run by --parallel, or a piece of an --!export; see
+   run_tasks().
+   */
+struct task
+{
+  char   *name;
+  char   *input;               /* what its sqlplus is told */
+  char   *log;                 /* where its output goes */
+  char   *connect;             /* if it is not run_tasks()' connect string */
+  double start;
+  double end;
+  int    status;               /* exit status of sqlplus, -1 if it did not start */
+  int    errors;               /* ORA- and SP2- messages in its output */
+  int    timed_out;
+};
+
+/*
+   One of the sqlplus processes run_tasks() keeps busy.
+   */
+struct worker
+{
+  pid_t  pid;
+  int    fdin;                 /* sqlplus output, -1 while idle */
+  int    log;
+  int    task;
+  int    llen;
+  char   last[BATCH_LINE];
+};
+
+static struct task *new_task(struct task **tasks, int *ntasks, const char *name, char *input, char *log)
+{
+  struct task *t;
+
+  *tasks = realloc(*tasks, (*ntasks+1)*sizeof(struct task));
+  t = &(*tasks)[(*ntasks)++];
+  t->name = strdup(name);
+  t->input = input;
+  t->log = log;
+  t->connect = (char *) 0;
+  t->start = 0;
+  t->end = 0;
+  t->status = -1;
+  t->errors = 0;
+  t->timed_out = 0;
+  return t;
+}
+
+/*
+   Script `name' is run with '@', so it behaves as it would for the
+   user at the SQL prompt; its log is `name'.log. The whole name is
+   kept, so that s1.sql does not overwrite a spool file s1.log of the
+   script itself.
+   */
+static void add_task(struct task **tasks, int *ntasks, const char *name)
+{
+  char   *input;
+  char   *log;
+
+  input = malloc(strlen(name)+10);
+  sprintf(input, "@%s\nexit\n", name);
+  log = malloc(strlen(name)+5);
+  sprintf(log, "%s.log", name);
+  new_task(tasks, ntasks, name, input, log);
+}
+
+/*
+   The lines of file `fname', such as a manifest of scripts, as a null
+   terminated list. Blank lines and lines starting with '#' are
+   skipped. Returns null if the file cannot be read.
+   */
+static char **read_list(const char *fname)
+{
+  int    len;
+  int    n = 0;
+  FILE   *fptr;
+  char   buffer[BUF_LEN];
+  char   *ptr;
+  char   **list;
+
+  if (!(fptr = fopen(fname, "r")))
   {
-    if (complete_columns == 1)
-      printf("gqlplus: scanning tables and columns...\n");
-    else
-      printf("gqlplus: scanning tables...\n");
+    perror(fname);
+    return (char **) 0;
   }
-  tables = get_completion_names(fds2[0], fds1[1], line);
-  if (tables)
-    completion_names = 1;
-  else
+  list = calloc(1, sizeof(char *));
+  while (fgets(buffer, BUF_LEN, fptr))
   {
-    /*
-       Something's wrong - we can't read or parse ALL_TABLES. Abandon
-       tablename completion. But warn the user.
-       */
-    fprintf(stderr, "Warning: couldn't query or parse ALL_TABLES or ALL_VIEWS. Tablename completion disabled.\n");
-    *all_tables = 0; 
+    buffer[strcspn(buffer, "\r\n")] = '\0';
+    ptr = buffer+strspn(buffer, WHITESPACE);
+    len = strlen(ptr);
+    while ((len > 0) && strchr(WHITESPACE, ptr[len-1]))
+      ptr[--len] = '\0';
+    if (!*ptr || (*ptr == '#'))
+      continue;
+    list = realloc(list, (n+2)*sizeof(char *));
+    list[n++] = strdup(ptr);
+    list[n] = (char *) 0;
   }
-  return completion_names;
+  fclose(fptr);
+  return list;
 }
 
 /*
-   Return the shell command (the argument of '!' or 'HO' SQLPLUS
-   commands).
+   Start a sqlplus for task `t' on worker `w'.
    */
-static char *get_shellcmd(char *lline)
+static int start_task(struct worker *w, struct task *t, char *connect_string, char *spath, char **enx)
 {
-  int  len;
-  char *shellcmd = (char *) 0;
-  char *xtr;
+  int    ppipe[2];
+  int    cpipe[2];
+  char   *xrgs[4];
+  char   *login;
 
-  if (lline[0] == '!')
+  w->log = open(t->log, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (w->log < 0)
   {
-    if (lline[1] == '\0')
-      shellcmd = getenv("SHELL");
-    else
-      shellcmd = &lline[1];
+    perror(t->log);
+    return -1;
   }
-  else if (!strncmp(lline, HOST_CMD, strlen(HOST_CMD)))
+  fcntl(w->log, F_SETFD, FD_CLOEXEC);
+  if (pipe(ppipe) < 0)
   {
-    xtr = lline;
-    len = strcspn(lline, " ");
-    xtr += len;
-    len = strspn(xtr, " ");
-    xtr += len;
-    if (strlen(xtr) != 0)
-      shellcmd = xtr;
-    else
-      shellcmd = getenv("SHELL");
+    perror((char *) 0);
+    close(w->log);
+    return -1;
   }
-  return shellcmd;
+  if (pipe(cpipe) < 0)
+  {
+    perror((char *) 0);
+    close(ppipe[0]);
+    close(ppipe[1]);
+    close(w->log);
+    return -1;
+  }
+  /*
+     The connect string goes down the pipe, not on the command line,
+     where ps would show the password.
+     */
+  xrgs[0] = spath;
+  xrgs[1] = "-s";
+  xrgs[2] = "/nolog";
+  xrgs[3] = (char *) 0;
+  w->pid = spawn_sqlplus(spath, xrgs, enx, ppipe, cpipe);
+  if (w->pid < 0)
+  {
+    perror((char *) 0);
+    close(ppipe[1]);
+    close(cpipe[0]);
+    close(w->log);
+    return -1;
+  }
+  connect_string = t->connect ? t->connect : connect_string;
+  login = malloc(strlen(TASK_CONNECT)+strlen(connect_string));
+  sprintf(login, TASK_CONNECT, connect_string);
+  write(ppipe[1], login, strlen(login));
+  free(login);
+  write(ppipe[1], t->input, strlen(t->input));
+  close(ppipe[1]);
+  w->fdin = cpipe[0];
+  w->llen = 0;
+  t->start = now();
+  return 0;
 }
 
 /*
-   Check if we have the complete connect string on the command line.
+   Worker `w' has reached end of file: its sqlplus is done.
    */
-static char *get_connect_string(int argc, char **argv)
+static void end_task(struct worker *w, struct task *t, int done, int ntasks)
 {
-  int  i;
-  int  done = 0;
-  char *str;
-  char *sid;
-  char *connect_string = (char *) 0;
+  int    child_stat;
+
+  close(w->fdin);
+  close(w->log);
+  w->fdin = -1;
+  if (w->llen && batch_error(w->last))
+    t->errors++;
+  while ((waitpid(w->pid, &child_stat, 0) < 0) && (errno == EINTR))
+    ;
+  t->end = now();
+  t->status = WIFEXITED(child_stat) ? WEXITSTATUS(child_stat) : 128+WTERMSIG(child_stat);
+  fprintf(stderr, "[%d/%d] %s: %s, %.2f seconds\n", done, ntasks, t->name,
+      t->timed_out ? "timed out" : ((t->status || t->errors) ? "failed" : "ok"), t->end-t->start);
+}
 
-  sid = getenv(ORACLE_SID);
-  for (i = 1; (i < argc) && (done == 0); i++)
+/*
+   Run the `ntasks' tasks, each on a sqlplus of its own connected as
+   `connect_string', `nworkers' at a time. A task still running after
+   `timeout' seconds, if it is not 0, is terminated. Ctrl-C stops the
+   tasks that are running and starts no more. Returns the number of
+   tasks that failed or did not run.
+   */
+static int run_tasks(struct task *tasks, int ntasks, int nworkers, char *connect_string, char *spath, char **enx, int timeout)
+{
+  int    i;
+  int    wait;
+  int    nfds;
+  int    next;
+  int    running;
+  int    done;
+  int    failed;
+  int    stopped;
+  int    nread;
+  int    *slot;
+  char   buffer[BUF_LEN];
+  double left;
+  struct worker *workers;
+  struct worker *w;
+  struct pollfd *pfd;
+
+  if (nworkers > ntasks)
+    nworkers = ntasks;
+  workers = calloc(nworkers, sizeof(struct worker));
+  pfd = calloc(nworkers, sizeof(struct pollfd));
+  slot = calloc(nworkers, sizeof(int));
+  for (i = 0; i < nworkers; i++)
+    workers[i].fdin = -1;
+  next = 0;
+  running = 0;
+  done = 0;
+  stopped = 0;
+  cancel_requested = 0;
+  sqlplus_busy = 1; /* Ctrl-C sets cancel_requested */
+  for (;;)
   {
-    str = argv[i];
-    if ((str[0] != '-') && (str[0] != '@'))
+    for (i = 0; (i < nworkers) && !cancel_requested && (next < ntasks); i++)
     {
-      if (strchr(str, '/'))
+      w = &workers[i];
+      if (w->fdin >= 0)
+        continue;
+      w->task = next++;
+      if (start_task(w, &tasks[w->task], connect_string, spath, enx) == 0)
+        running++;
+      else
       {
-        if (strchr(str, '@'))
-          connect_string = strdup(str);
-        else if (sid != (char *) 0)
+        /*
+           Recorded as having ended with status -1, so that the summary
+           tells it from a task that was never started; the worker takes
+           the next one.
+           */
+        tasks[w->task].start = tasks[w->task].end = now();
+        done++;
+        i--;
+      }
+    }
+    if (cancel_requested && !stopped)
+    {
+      fprintf(stderr, "gqlplus: stopping the tasks that are running\n");
+      for (i = 0; i < nworkers; i++)
+        if (workers[i].fdin >= 0)
+          kill(workers[i].pid, SIGTERM);
+      stopped = 1;
+    }
+    if (!running)
+      break;
+    nfds = 0;
+    wait = -1;
+    for (i = 0; i < nworkers; i++)
+      if (workers[i].fdin >= 0)
+      {
+        pfd[nfds].fd = workers[i].fdin;
+        pfd[nfds].events = POLLIN;
+        slot[nfds++] = i;
+        if (timeout && !tasks[workers[i].task].timed_out)
         {
-          connect_string = malloc(strlen(str)+strlen(sid)+2);
-          sprintf(connect_string, "%s@%s", str, sid);
+          left = tasks[workers[i].task].start+timeout-now();
+          if (left <= 0)
+          {
+            kill(workers[i].pid, SIGTERM);
+            tasks[workers[i].task].timed_out = 1;
+          }
+          else if ((wait < 0) || (left*1000 < wait))
+            wait = left*1000+1;
         }
       }
-      else
-        username = strdup(str);
+    if (poll(pfd, nfds, wait) < 0)
+    {
+      if (errno == EINTR)
+        continue;
+      perror("run_tasks()");
+      break;
+    }
+    for (i = 0; i < nfds; i++)
+    {
+      if (!pfd[i].revents)
+        continue;
+      w = &workers[slot[i]];
+      nread = read(w->fdin, buffer, BUF_LEN);
+      if (nread > 0)
+      {
+        write(w->log, buffer, nread);
+        tasks[w->task].errors += scan_errors(w->last, &w->llen, buffer, nread, 0);
+      }
+      else if ((nread == 0) || (errno != EINTR))
+      {
+        end_task(w, &tasks[w->task], ++done, ntasks);
+        running--;
+      }
     }
   }
-  return connect_string;
+  cancel_requested = 0;
+  free(workers);
+  free(pfd);
+  free(slot);
+  failed = 0;
+  for (i = 0; i < ntasks; i++)
+    if (!tasks[i].end || tasks[i].status || tasks[i].errors || tasks[i].timed_out)
+      failed++;
+  return failed;
 }
 
 /*
-   Build connect string from username, password, ORACLE_SID.
+   gqlplus --parallel N connect_string script... runs the scripts,
+   each on a sqlplus of its own, N at a time, and sends the output of
+   each to a log file named after it. An argument that does not end in
+   .sql is a manifest listing scripts. Returns 0 if every script ran
+   without error.
    */
-static char *build_connect_string(char *user, char *password)
+static int run_parallel(int nworkers, int argc, char **argv, char *spath, char **enx)
 {
-  char *connect_string = (char *) 0;
-  char *sid;
-  char **tokens;
-
-  sid = getenv(ORACLE_SID);
-  if (strchr(user, '@'))
+  int    i;
+  int    j;
+  int    len;
+  int    failed;
+  int    ntasks = 0;
+  char   *connect_string;
+  char   **list;
+  double start;
+  double work;
+  struct task *tasks = (struct task *) 0;
+
+  connect_string = get_connect_string(argc, argv);
+  for (i = 1; (i < argc) && ((argv[i][0] == '-') || !strchr(argv[i], '/')); i++)
+    ;
+  for (i++; i < argc; i++)
   {
-    if (strchr(user, '/'))
-      connect_string = strdup(user);
-    else if ((password != (char *) 0))
+    len = strlen(argv[i]);
+    if ((len > (int) strlen(SQLEXT)) && !strcmp(argv[i]+len-strlen(SQLEXT), SQLEXT))
+      add_task(&tasks, &ntasks, argv[i]);
+    else if ((list = read_list(argv[i])))
     {
-      tokens = str_tokenize(user, "@");
-      connect_string = malloc(strlen(user)+strlen(password)+3);
-      sprintf(connect_string, "%s/%s@%s", tokens[0], password, tokens[1]);
-      str_free(tokens);
+      for (j = 0; list[j]; j++)
+        add_task(&tasks, &ntasks, list[j]);
+      str_free(list);
     }
+    else
+      return 1;
   }
-  else if (password && (strchr(password, '@')))
+  if (!connect_string || !ntasks || (nworkers < 1))
   {
-    connect_string = malloc(strlen(user)+strlen(password)+3);
-    sprintf(connect_string, "%s/%s", user, password);
+    fprintf(stderr, "usage: gqlplus --parallel N user/password[@database] script.sql|manifest...\n");
+    return 1;
   }
-  else
+  start = now();
+  failed = run_tasks(tasks, ntasks, nworkers, connect_string, spath, enx, 0);
+  /*
+     Summary.
+     */
+  work = 0;
+  printf("\n%-32s %-8s %5s %7s %10s  %s\n", "Script", "Result", "Exit", "Errors", "Seconds", "Log");
+  for (i = 0; i < ntasks; i++)
   {
-    if (sid != (char *) 0)
+    if (!tasks[i].end)
     {
-      if (strchr(user, '/'))
-      {
-        connect_string = malloc(strlen(user)+strlen(sid)+2);
-        sprintf(connect_string, "%s@%s", user, sid);
-      }
-      else if (password != (char *) 0)
-      {
-        connect_string = malloc(strlen(user)+strlen(password)+strlen(sid)+3);
-        sprintf(connect_string, "%s/%s@%s", user, password, sid);
-      }
+      printf("%-32s %-8s\n", tasks[i].name, "not run");
+      continue;
     }
+    if (tasks[i].status < 0)
+    {
+      printf("%-32s %-8s\n", tasks[i].name, "failed to start");
+      continue;
+    }
+    work += tasks[i].end-tasks[i].start;
+    printf("%-32s %-8s %5d %7d %10.2f  %s\n", tasks[i].name,
+        (tasks[i].status || tasks[i].errors) ? "failed" : "ok",
+        tasks[i].status, tasks[i].errors, tasks[i].end-tasks[i].start, tasks[i].log);
   }
-  return connect_string;
+  printf("%d scripts, %d failed or not run; %.2f seconds, %.2f seconds of sqlplus time\n",
+      ntasks, failed, now()-start, work);
+  return failed ? 1 : 0;
 }
 
 /*
-   Call sqlplus to extract the initial sqlplus prompt. This is needed
-   in case a user has a (g)login.sql file which redefines the standard
-   prompt.
+   gqlplus --fanout targets -e statement runs the statement on every
+   database of file `targets', one connect string per line, on a
+   sqlplus of its own, N at a time. The output is reported in the
+   order of the file, each line tagged with the connect string less
+   its password; a target that fails or times out does not hold up
+   the others. Returns 0 if the statement ran everywhere without
+   error.
    */
-static char *get_sql_prompt(char *old_prompt, char *sqlplus, char *connect_string, char *line, int *status)
+static int run_fanout(char *targets, char *stmt, int nworkers, char *spath, char **enx)
 {
-  int  len;
-  char *sqlprompt = (char *) 0;
-  char *cmd;
-  char *xtr;
-  char *ptr;
-  char tmpdir[500]="";
-  char *env_tmpdir;
-  int  fd;
-
-  if (connect_string){
-    if (env_tmpdir=getenv("TMPDIR")){
-    }else if (env_tmpdir=getenv("TEMPDIR")){
-    }else{
-      env_tmpdir=getenv("TEMP");
-    }
-    if (env_tmpdir){
-      strcpy(tmpdir, env_tmpdir);
-    }else{
-      strcpy(tmpdir, "/tmp");
-    }
-    strcat(tmpdir, "/gqlplus.XXXXXX");
-    //printf("tmpdir: %s\n", tmpdir);
-    fd = mkstemp(tmpdir);
-    unlink(tmpdir);
-    if (fd < 0) {
-        fprintf(stderr, "%s: %s\n", tmpdir, strerror(errno));
-        close(fd);
-        return (NULL);
-    }
-    *status = 0;
-    /* still a lot todo */
-    cmd = malloc(strlen(GET_PROMPT)+strlen(TAIL_PROMPT)+strlen(sqlplus)+strlen(connect_string)+strlen(tmpdir)+20);
-    sprintf(cmd, "%s%s -s \"%s\" %s > %s", GET_PROMPT, sqlplus, connect_string, TAIL_PROMPT, tmpdir);
-    /*printf("cmd: `%s'\n", cmd);*/
-    *status = system(cmd);
-    if (!*status){
-      free(cmd);
-      xtr = read_file(tmpdir, line);
-      unlink(tmpdir);
-      
-         //Get the last line.
-      xtr = strstr(xtr, SQLPROMPT);
-      if (xtr){
-        if (!strcmp(xtr, "\n") || strncmp(xtr, SQLPROMPT, strlen(SQLPROMPT)))
-          sqlprompt = old_prompt;
-        else{
-            /*
-             Is this user using (g)login.sql? And if so, is she
-             setting sqlprompt?
-             */
-          ptr = strchr(xtr, '"');
-          ptr++;
-          len = strcspn(ptr, "\"");
-          sqlprompt = malloc(len+1);
-          memcpy(sqlprompt, ptr, len);
-          sqlprompt[len] = '\0';
-        }
+  int    i;
+  int    width;
+  int    start_of_line;
+  int    fd;
+  int    failed;
+  int    ntasks = 0;
+  char   tag[20];
+  char   *input;
+  char   *fname;
+  char   *ident;
+  char   **list;
+  char   buffer[BUF_LEN];
+  double start;
+  struct task *tasks = (struct task *) 0;
+  struct task *t;
+  FILE   *fptr;
+
+  if (!targets || !stmt || (nworkers < 1))
+  {
+    fprintf(stderr, "usage: gqlplus --fanout targets [--parallel N] [--timeout seconds] -e statement\n");
+    return 1;
+  }
+  if (!(list = read_list(targets)))
+    return 1;
+  width = 0;
+  for (i = 0; list[i]; i++)
+  {
+    /*
+       The output files are made here, private, and only reopened
+       by start_task().
+       */
+    sprintf(tag, "fanout%d", i+1);
+    if ((fd = temp_file(tag, &fname)) < 0)
+      break;
+    close(fd);
+    ident = connect_identity(list[i]);
+    if ((int) strlen(ident) > width)
+      width = strlen(ident);
+    input = statement_input(FANOUT_SETTINGS, stmt);
+    t = new_task(&tasks, &ntasks, ident, input, fname);
+    t->connect = list[i];
+    free(ident);
+  }
+  if (list[i])
+  {
+    for (i = 0; i < ntasks; i++)
+      unlink(tasks[i].log);
+    return 1;
+  }
+  start = now();
+  failed = run_tasks(tasks, ntasks, nworkers, (char *) 0, spath, enx, statement_timeout);
+  /*
+     The report.
+     */
+  for (i = 0; i < ntasks; i++)
+  {
+    t = &tasks[i];
+    if ((fptr = fopen(t->log, "r")))
+    {
+      start_of_line = 1;
+      while (fgets(buffer, BUF_LEN, fptr))
+      {
+        if (start_of_line && (buffer[strspn(buffer, " \t\r\n")] == '\0'))
+          continue;
+        if (start_of_line)
+          printf("%-*s | ", width, t->name);
+        fputs(buffer, stdout);
+        start_of_line = (buffer[strlen(buffer)-1] == '\n');
       }
+      if (!start_of_line)
+        printf("\n");
+      fclose(fptr);
+      unlink(t->log);
     }
+    if (!t->end)
+      printf("%-*s | ** not run\n", width, t->name);
+    else if (t->status < 0)
+      printf("%-*s | ** failed to start\n", width, t->name);
+    else if (t->timed_out)
+      printf("%-*s | ** timed out after %d seconds\n", width, t->name, statement_timeout);
+    else if (t->status || t->errors)
+      printf("%-*s | ** failed, exit status %d\n", width, t->name, t->status);
+    free(t->name);
+    free(t->input);
+    free(t->log);
   }
-  return sqlprompt;
+  printf("%d targets, %d failed, timed out or not run; %.2f seconds\n", ntasks, failed, now()-start);
+  free(tasks);
+  str_free(list);
+  return failed ? 1 : 0;
 }
 
-static void usage(int argc, char **argv)
+/*
+   A statement of a --!capture file, and what became of it on replay.
+   */
+struct captured
 {
-  int i;
-  int done;
+  char   *text;
+  double think;                /* seconds the user took before it */
+  double elapsed;              /* seconds it ran when captured */
+  double *latency;             /* seconds it ran on replay, per session */
+  int    nlatency;
+  int    errors;
+};
 
-  done = 0;
-  for (i = 0; (i < argc) && !done; i++)
-    if (!strcmp(argv[i], "-h"))
+/*
+   One of the sqlplus sessions run_replay() drives.
+   */
+struct replayer
+{
+  pid_t  pid;
+  int    fdin;                 /* sqlplus output, -1 once it has exited */
+  int    fdout;                /* sqlplus input, -1 once all is sent */
+  int    next;                 /* statement running or due next */
+  int    busy;                 /* waiting for REPLAY_MARK */
+  double due;                  /* when statement `next' goes out */
+  double sent;
+  int    llen;
+  char   last[BATCH_LINE];
+};
+
+static struct captured *read_capture(const char *fname, int *n)
+{
+  int    len;
+  FILE   *fptr;
+  char   buffer[BUF_LEN];
+  double start;
+  struct captured *stmts = (struct captured *) 0;
+  struct captured *s;
+
+  *n = 0;
+  if (!(fptr = fopen(fname, "r")))
+  {
+    perror(fname);
+    return stmts;
+  }
+  while (fgets(buffer, BUF_LEN, fptr))
+  {
+    if (strncmp(buffer, CAPTURE_HEADER, strlen(CAPTURE_HEADER)))
+      continue;
+    stmts = realloc(stmts, (*n+1)*sizeof(struct captured));
+    s = &stmts[*n];
+    if ((sscanf(buffer+strlen(CAPTURE_HEADER), "%lf think %lf elapsed %lf bytes %d",
+          &start, &s->think, &s->elapsed, &len) != 4) || (len < 0))
+      continue;
+    s->text = malloc(len+1);
+    if (fread(s->text, 1, len, fptr) != (size_t) len)
     {
-      done = 1;
-      printf("\ngqlplus version %s; usage: gqlplus [sqlplus_options] [-h] [-d] [-p]\n", VERSION);
-      printf("      \"-h\" this messsage\n");
-      printf("      \"-d\" disable column name completion\n");
-      printf("      \"-p\" show progress report and elapsed time\n");
-      printf("      SQL> %sr: rescan tables (for completion)\n", szCmdPrefix);
-      printf("      SQL> %sh: display command history\n", szCmdPrefix);
-      printf("To kill the program, use SIGQUIT (Ctrl-\\)\n");
+      free(s->text);
+      break;
     }
+    s->text[len] = '\0';
+    s->latency = (double *) 0;
+    s->nlatency = 0;
+    s->errors = 0;
+    (*n)++;
+  }
+  fclose(fptr);
+  return stmts;
 }
 
-static char *str_expand(char *str, int *capacity, int length, int extension)
+static int double_compare(const void *a, const void *b)
 {
-  int  new_length;
-  char *xstr;
+  double x = *(const double *) a;
+  double y = *(const double *) b;
 
-  xstr = str;
-  new_length = length+extension;
-  if (new_length > *capacity)
+  return (x < y) ? -1 : (x > y);
+}
+
+/*
+   Nearest-rank percentile `p' of the `n' sorted values `v'.
+   */
+static double percentile(const double *v, int n, double p)
+{
+  int i;
+
+  i = (int) (p*n+0.999999)-1;
+  return v[(i < 0) ? 0 : ((i >= n) ? n-1 : i)];
+}
+
+static struct captured *sort_stmts;
+
+static int captured_compare(const void *a, const void *b)
+{
+  return strcmp(sort_stmts[*(const int *) a].text, sort_stmts[*(const int *) b].text);
+}
+
+/*
+   Latency percentiles of the replay, per distinct statement (the
+   REPLAY_TOP that took the longest in all) and overall.
+   */
+static void replay_report(struct captured *stmts, int n)
+{
+  int    i;
+  int    j;
+  int    k;
+  int    m;
+  int    ngroups;
+  int    *order;
+  int    all;
+  int    errors;
+  double *v;
+  double then;
+  double *total;
+  int    *first;
+  int    *count;
+  char   text[41];
+
+  /*
+     Identical statements are reported together.
+     */
+  order = malloc(n*sizeof(int));
+  for (i = 0; i < n; i++)
+    order[i] = i;
+  sort_stmts = stmts;
+  qsort(order, n, sizeof(int), captured_compare);
+  first = malloc((n+1)*sizeof(int));
+  total = malloc(n*sizeof(double));
+  ngroups = 0;
+  for (i = 0; i < n; i++)
+    if (!i || strcmp(stmts[order[i]].text, stmts[order[i-1]].text))
+      first[ngroups++] = i;
+  first[ngroups] = n;
+  count = malloc(ngroups*sizeof(int));
+  all = 0;
+  for (k = 0; k < ngroups; k++)
   {
-    while (*capacity <= new_length)
-      *capacity += *capacity;
-    xstr = realloc(str, *capacity+1);
+    total[k] = 0;
+    count[k] = 0;
+    for (i = first[k]; i < first[k+1]; i++)
+    {
+      for (j = 0; j < stmts[order[i]].nlatency; j++)
+        total[k] += stmts[order[i]].latency[j];
+      count[k] += stmts[order[i]].nlatency;
+    }
+    all += count[k];
   }
-  return xstr;
+  v = malloc((all+1)*sizeof(double));
+  printf("\n%-40s %6s %6s %10s %10s %10s %10s %10s\n", "Statement", "Runs", "Errors",
+      "p50 ms", "p90 ms", "p99 ms", "max ms", "then ms");
+  for (m = 0; m < ngroups && m < REPLAY_TOP; m++)
+  {
+    /*
+       The group with the largest total not reported yet.
+       */
+    for (j = -1, k = 0; k < ngroups; k++)
+      if ((total[k] >= 0) && ((j < 0) || (total[k] > total[j])))
+        j = k;
+    total[j] = -1;
+    if (!count[j])
+      continue;
+    all = 0;
+    errors = 0;
+    then = 0;
+    for (i = first[j]; i < first[j+1]; i++)
+    {
+      memcpy(v+all, stmts[order[i]].latency, stmts[order[i]].nlatency*sizeof(double));
+      all += stmts[order[i]].nlatency;
+      errors += stmts[order[i]].errors;
+      then += stmts[order[i]].elapsed;
+    }
+    qsort(v, all, sizeof(double), double_compare);
+    for (i = 0; stmts[order[first[j]]].text[i] && (i < 40); i++)
+      text[i] = isspace((int) stmts[order[first[j]]].text[i]) ? ' ' : stmts[order[first[j]]].text[i];
+    text[i] = '\0';
+    printf("%-40s %6d %6d %10.2f %10.2f %10.2f %10.2f %10.2f\n", text, all, errors,
+        1000*percentile(v, all, 0.5), 1000*percentile(v, all, 0.9), 1000*percentile(v, all, 0.99),
+        1000*v[all-1], 1000*then/(first[j+1]-first[j]));
+  }
+  all = 0;
+  errors = 0;
+  for (i = 0; i < n; i++)
+  {
+    memcpy(v+all, stmts[i].latency, stmts[i].nlatency*sizeof(double));
+    all += stmts[i].nlatency;
+    errors += stmts[i].errors;
+  }
+  if (all)
+  {
+    qsort(v, all, sizeof(double), double_compare);
+    printf("%-40s %6d %6d %10.2f %10.2f %10.2f %10.2f\n", "All", all, errors,
+        1000*percentile(v, all, 0.5), 1000*percentile(v, all, 0.9), 1000*percentile(v, all, 0.99),
+        1000*v[all-1]);
+  }
+  free(v);
+  free(count);
+  free(total);
+  free(first);
+  free(order);
 }
 
-static void get_final_sqlplus(int fdin)
+/*
+   gqlplus --replay file [--parallel N] [--speed X] connect_string
+   replays a --!capture file on N sqlplus sessions at once, each
+   running all of it with the think times of the capture divided by X
+   (0 for none). A statement is followed by a PROMPT of REPLAY_MARK,
+   so its latency runs from sending it until the mark comes back.
+   Returns 0 if the replay ran without errors.
+   */
+static int run_replay(char *fname, int nsessions, double speed, int argc, char **argv, char *spath, char **enx)
 {
-  int  flags;
-  int  result;
-  int  capacity;
-  int  llen;
-  char *response;
-  char buffer[BUF_LEN];
-
-  usleep(100000);
-  response = malloc((INIT_LINE_LENGTH+1)*sizeof(char));
-  response[0] = '\0';
-  capacity = INIT_LINE_LENGTH;
-  llen = 0;
+  int    i;
+  int    n;
+  int    nfds;
+  int    wait;
+  int    alive;
+  int    nread;
+  int    child_stat;
+  int    errors;
+  int    failed;
+  int    ppipe[2];
+  int    cpipe[2];
+  int    *slot;
+  char   *xrgs[4];
+  char   *connect_string;
+  char   *ptr;
+  char   *eol;
+  char   *mark;
+  char   buffer[BUF_LEN];
+  double start;
+  double t;
+  struct captured *stmts;
+  struct captured *s;
+  struct replayer *replayers;
+  struct replayer *r;
+  struct pollfd *pfd;
+
+  connect_string = get_connect_string(argc, argv);
+  stmts = read_capture(fname, &n);
+  if (!connect_string || !n || (nsessions < 1) || (speed < 0))
+  {
+    fprintf(stderr, "usage: gqlplus --replay file [--parallel N] [--speed X] user/password[@database]\n");
+    return 1;
+  }
+  for (i = 0; i < n; i++)
+    stmts[i].latency = malloc(nsessions*sizeof(double));
+  replayers = calloc(nsessions, sizeof(struct replayer));
+  pfd = calloc(nsessions, sizeof(struct pollfd));
+  slot = calloc(nsessions, sizeof(int));
   /*
-     Get sqlplus output without blocking.
+     The connect string goes down the pipe, as in start_task(); a
+     session that cannot log in exits, instead of taking what follows
+     for a user name and password.
      */
-  flags = fcntl(fdin, F_GETFL, 0);
-  fcntl(fdin, F_SETFL, (flags | O_NDELAY));
-  result = read(fdin, buffer, BUF_LEN);
-  if (result > 0)
+  mark = malloc(strlen(TASK_CONNECT)+strlen(connect_string)+strlen(FANOUT_SETTINGS)+strlen(REPLAY_MARK)+20);
+  sprintf(mark, TASK_CONNECT, connect_string);
+  sprintf(mark+strlen(mark), "%sprompt %s\n", FANOUT_SETTINGS, REPLAY_MARK);
+  xrgs[0] = spath;
+  xrgs[1] = "-s";
+  xrgs[2] = "/nolog";
+  xrgs[3] = (char *) 0;
+  for (i = 0; i < nsessions; i++)
+  {
+    replayers[i].fdin = -1;
+    replayers[i].fdout = -1;
+  }
+  alive = 0;
+  failed = 0;
+  start = now();
+  for (i = 0; i < nsessions; i++)
+  {
+    r = &replayers[i];
+    if ((pipe(ppipe) < 0) || (pipe(cpipe) < 0) ||
+        ((r->pid = spawn_sqlplus(spath, xrgs, enx, ppipe, cpipe)) < 0))
+    {
+      perror("run_replay()");
+      failed += nsessions-i;
+      break;
+    }
+    r->fdin = cpipe[0];
+    r->fdout = ppipe[1];
+    /*
+       The first mark says the session is logged in.
+       */
+    write(r->fdout, mark, strlen(mark));
+    r->next = -1;
+    r->busy = 1;
+    alive++;
+  }
+  strcpy(mark, "prompt " REPLAY_MARK "\n");
+  cancel_requested = 0;
+  sqlplus_busy = 1; /* Ctrl-C sets cancel_requested */
+  while (alive && !cancel_requested)
+  {
+    t = now();
+    wait = -1;
+    nfds = 0;
+    for (i = 0; i < nsessions; i++)
+    {
+      r = &replayers[i];
+      if (r->fdin < 0)
+        continue;
+      if (!r->busy && (r->fdout >= 0))
+      {
+        if (r->next >= n)
+        {
+          close(r->fdout);
+          r->fdout = -1;
+        }
+        else if (r->due <= t)
+        {
+          s = &stmts[r->next];
+          write(r->fdout, s->text, strlen(s->text));
+          write(r->fdout, "\n", 1);
+          write(r->fdout, mark, strlen(mark));
+          r->sent = now();
+          r->busy = 1;
+        }
+        else if ((wait < 0) || ((r->due-t)*1000 < wait))
+          wait = (r->due-t)*1000+1;
+      }
+      pfd[nfds].fd = r->fdin;
+      pfd[nfds].events = POLLIN;
+      slot[nfds++] = i;
+    }
+    if (poll(pfd, nfds, wait) < 0)
+    {
+      if (errno == EINTR)
+        continue;
+      perror("run_replay()");
+      break;
+    }
+    for (i = 0; i < nfds; i++)
+    {
+      if (!pfd[i].revents)
+        continue;
+      r = &replayers[slot[i]];
+      nread = read(r->fdin, buffer, BUF_LEN);
+      if ((nread < 0) && (errno == EINTR))
+        continue;
+      if (nread <= 0)
+      {
+        close(r->fdin);
+        r->fdin = -1;
+        if (r->fdout >= 0)
+          close(r->fdout);
+        r->fdout = -1;
+        while ((waitpid(r->pid, &child_stat, 0) < 0) && (errno == EINTR))
+          ;
+        alive--;
+        if (r->next < 0)
+          fprintf(stderr, "gqlplus: session %d could not log in\n", slot[i]+1);
+        else if (r->next < n)
+          fprintf(stderr, "gqlplus: session %d ended after %d statements\n", slot[i]+1, r->next);
+        if (r->next < n)
+          failed++;
+        continue;
+      }
+      /*
+         Only whole lines matter: the mark, or an error of the
+         statement that is running.
+         */
+      for (ptr = buffer; ptr < buffer+nread; ptr = eol+1)
+      {
+        if (!(eol = memchr(ptr, '\n', buffer+nread-ptr)))
+          eol = buffer+nread;
+        errors = scan_errors(r->last, &r->llen, ptr, (eol < buffer+nread) ? eol-ptr+1 : eol-ptr, 0);
+        if ((r->next >= 0) && (r->next < n))
+          stmts[r->next].errors += errors;
+        if ((eol < buffer+nread) && r->busy && !strncmp(r->last, REPLAY_MARK, strlen(REPLAY_MARK)))
+        {
+          t = now();
+          if (r->next >= 0)
+          {
+            s = &stmts[r->next];
+            s->latency[s->nlatency++] = t-r->sent;
+          }
+          r->busy = 0;
+          r->next++;
+          if (r->next < n)
+            r->due = t+(speed ? stmts[r->next].think/speed : 0);
+        }
+      }
+    }
+  }
+  sqlplus_busy = 0;
+  if (cancel_requested)
   {
-    response = str_expand(response, &capacity, llen, result);
-    memcpy(&response[llen], buffer, result);
-    llen += result;
-    response[llen] = '\0';
+    fprintf(stderr, "gqlplus: replay cancelled\n");
+    for (i = 0; i < nsessions; i++)
+      if (replayers[i].fdin >= 0)
+      {
+        kill(replayers[i].pid, SIGTERM);
+        waitpid(replayers[i].pid, &child_stat, 0);
+      }
+    cancel_requested = 0;
+  }
+  replay_report(stmts, n);
+  errors = 0;
+  for (i = 0, nread = 0; i < n; i++)
+  {
+    errors += stmts[i].errors;
+    nread += stmts[i].nlatency;
   }
-  printf("%s", response);
+  t = now()-start;
+  printf("%d sessions at speed %g: %d statements in %.2f seconds, %.1f per second\n",
+      nsessions, speed, nread, t, t ? nread/t : 0.0);
+  if (failed)
+    printf("%d sessions failed\n", failed);
+  for (i = 0; i < n; i++)
+  {
+    free(stmts[i].text);
+    free(stmts[i].latency);
+  }
+  free(stmts);
+  free(mark);
+  free(slot);
+  free(pfd);
+  free(replayers);
+  return (errors || failed) ? 1 : 0;
 }
 
 /*
-   Get current time information. Utility function to display time
-   information in the prompt. Contributed by Mark Harrison of Pixar.
+   --!export [owner.]table [to dir] [parallel n] unloads the table as
+   CSV, one file per ROWID range, n ranges at a time. The ranges are
+   cut from the extents of the table so that they hold about the same
+   number of blocks, EXPORT_RANGES per worker. Without access to
+   DBA_EXTENTS the rows are split by ORA_HASH(ROWID) instead, and each
+   worker reads all of the table. A manifest lists the files.
    */
-static double now()
+static void export_table(char *args, char *spath, char **enx, char *connect_string, char *line)
 {
-  struct timeval tod;
-  gettimeofday(&tod, NULL);
-  return tod.tv_sec + (tod.tv_usec/1000000.0);
+  int    i;
+  int    n;
+  int    fd;
+  int    bad = 0;
+  int    nworkers = EXPORT_WORKERS;
+  int    nranges;
+  int    ntasks = 0;
+  int    failed;
+  char   *name = (char *) 0;
+  char   *dir = ".";
+  char   *table;
+  char   *schema;
+  char   *query;
+  char   *str;
+  char   *ptr;
+  char   *eol;
+  char   *input;
+  char   *fname;
+  char   **tokens;
+  char   lo[EXPORT_ROWID];
+  char   hi[EXPORT_ROWID];
+  double start;
+  long long bytes;
+  struct stat st;
+  struct task *tasks = (struct task *) 0;
+  FILE   *fptr;
+
+  tokens = str_tokenize(args ? args : "", WHITESPACE);
+  for (i = 0; tokens[i] && !bad; i++)
+  {
+    if (!strcasecmp(tokens[i], "to") && tokens[i+1])
+      dir = tokens[++i];
+    else if (!strcasecmp(tokens[i], "parallel") && tokens[i+1])
+      nworkers = atoi(tokens[++i]);
+    else if (!name)
+      name = tokens[i];
+    else
+      bad = 1;
+  }
+  if (bad || !name || (nworkers < 1) || (strspn(name, EXPORT_NAME_CHARS) != strlen(name)))
+  {
+    printf("Usage: %sexport [owner.]table [to dir] [parallel n]\n", szCmdPrefix);
+    str_free(tokens);
+    return;
+  }
+  /*
+     The workers log in on their own; without a password, sqlplus
+     would take the settings for one.
+     */
+  if (!connect_string || !strchr(connect_string, '/'))
+  {
+    printf("Not connected; %sexport needs a connect string with a password.\n", szCmdPrefix);
+    str_free(tokens);
+    return;
+  }
+  if ((stat(dir, &st) < 0) || !S_ISDIR(st.st_mode))
+  {
+    printf("%s is not a directory.\n", dir);
+    str_free(tokens);
+    return;
+  }
+  /*
+     `table' is the name to select from, `schema' the owner as the
+     data dictionary knows it.
+     */
+  table = strdup(name);
+  for (ptr = table; *ptr; ptr++)
+    *ptr = toupper((int) *ptr);
+  if ((ptr = strchr(table, '.')))
+  {
+    name = ptr+1;
+    schema = malloc(ptr-table+3);
+    sprintf(schema, "'%.*s'", (int) (ptr-table), table);
+  }
+  else
+  {
+    name = table;
+    schema = strdup("sys_context('userenv', 'current_schema')");
+  }
+  /*
+     The ranges come from a sqlplus of their own, with settings that
+     the user's session cannot spoil (LINESIZE, MARKUP, HEADING).
+     */
+  nranges = nworkers*EXPORT_RANGES;
+  query = malloc(strlen(EXPORT_RANGES_SQL)+strlen(schema)+strlen(name)+20);
+  sprintf(query, EXPORT_RANGES_SQL, nranges, schema, name);
+  if ((fd = temp_file("extents", &fname)) < 0)
+  {
+    free(query);
+    free(schema);
+    free(table);
+    str_free(tokens);
+    return;
+  }
+  close(fd);
+  new_task(&tasks, &ntasks, "extents", statement_input(FANOUT_SETTINGS, query), fname);
+  run_tasks(tasks, ntasks, 1, connect_string, spath, enx, 0);
+  if (!(str = read_file(fname, line)))
+    str = strdup("");
+  unlink(fname);
+  free(tasks[0].name);
+  free(tasks[0].input);
+  free(tasks[0].log);
+  ntasks = 0;
+  free(query);
+  start = now();
+  for (ptr = str, n = 0; *ptr; ptr = eol)
+  {
+    eol = ptr+strcspn(ptr, "\n");
+    if (*eol)
+      eol++;
+    if (sscanf(ptr, "RANGE %18s %18s", lo, hi) != 2)
+      continue;
+    input = malloc(strlen(EXPORT_SETTINGS)+strlen(table)+100);
+    sprintf(input, "%sselect * from %s where rowid between '%s' and '%s';\nexit\n",
+        EXPORT_SETTINGS, table, lo, hi);
+    fname = malloc(strlen(dir)+strlen(name)+20);
+    sprintf(fname, "%s/%s_%03d.csv", dir, name, ++n);
+    new_task(&tasks, &ntasks, fname, input, fname);
+  }
+  if (!ntasks)
+  {
+    /*
+       An error means no access to DBA_EXTENTS; no error and no
+       extents, a table without a segment.
+       */
+    nranges = strstr(str, "ORA-") ? nworkers : 1;
+    if (nranges > 1)
+      printf("Cannot read DBA_EXTENTS; splitting %s by ORA_HASH(ROWID).\n", table);
+    else
+      printf("No extents found for %s; exporting it as one file.\n", table);
+    for (n = 0; n < nranges; n++)
+    {
+      input = malloc(strlen(EXPORT_SETTINGS)+strlen(table)+100);
+      sprintf(input, "%sselect * from %s where ora_hash(rowid, %d) = %d;\nexit\n",
+          EXPORT_SETTINGS, table, nranges-1, n);
+      fname = malloc(strlen(dir)+strlen(name)+20);
+      sprintf(fname, "%s/%s_%03d.csv", dir, name, n+1);
+      new_task(&tasks, &ntasks, fname, input, fname);
+    }
+  }
+  free(str);
+  failed = run_tasks(tasks, ntasks, nworkers, connect_string, spath, enx, 0);
+  /*
+     The manifest lists every file with its size and whether it is
+     complete.
+     */
+  fname = malloc(strlen(dir)+strlen(name)+20);
+  sprintf(fname, "%s/%s.manifest", dir, name);
+  if (!(fptr = fopen(fname, "w")))
+    perror(fname);
+  bytes = 0;
+  for (i = 0; i < ntasks; i++)
+  {
+    if (stat(tasks[i].log, &st) < 0)
+      st.st_size = 0;
+    bytes += st.st_size;
+    if (fptr)
+      fprintf(fptr, "%s %lld %s\n", tasks[i].log, (long long) st.st_size,
+          !tasks[i].end ? "not-run" : ((tasks[i].status || tasks[i].errors) ? "failed" : "ok"));
+    free(tasks[i].name);
+    free(tasks[i].input);
+    free(tasks[i].log);
+  }
+  if (fptr)
+    fclose(fptr);
+  printf("%d files, %lld bytes in %.2f seconds; %d failed or not run. Manifest: %s\n",
+      ntasks, bytes, now()-start, failed, fname);
+  free(fname);
+  free(tasks);
+  free(schema);
+  free(table);
+  str_free(tokens);
 }
 
 int main(int argc, char **argv)
 {
   int    status;
   int    i;
-  int    fd;
   int    flags;
   int    completion_names = 0;
   int    all_tables = 1; /* set to 0 if we cannot query or parse ALL_TABLES or ALL_VIEWS */
-  int    pause_mode;
+  int    batch_mode;
+  int    stop_on_error = 0;
+  int    stopped = 0;
+  int    parallel = 0;
   int    pstat;
+  char   *fanout;
+  char   *estmt;
+  char   *replay;
+  double speed = 1;
+  int    len;
+  int    sql_input;
   char   *password = (char *) 0;
-  char   *connect_string;
+  char   *connect_string = (char *) 0;
   char   *path;
   char   *spath;
-  char   *prompt;
+  char   *prompt = (char *) 0;
   char   *prompt2;
   double tod1, tod2;
   char   *line;
@@ -2663,14 +7266,16 @@ int main(int argc, char **argv)
   char   *lline;
   char   *oline;
   char   *nptr;
+  char   *ptr;
   char   *shellcmd;
   char   *accept;
+  char   *stmt = (char *) 0;
   char   *ed;
   char   **editor;
   char   **xrgs;
   char   **tokens;
+  enum command_id cmd;
   char   **enx;
-  FILE   *fptr2;
   struct termios buf;
   struct termios save_termios;
 
@@ -2692,7 +7297,40 @@ int main(int argc, char **argv)
       quit_sqlplus = 1;
   }
   pause_mode = 0;
-  initialize_history("sqlplus");
+  if ((ptr = getenv("GQLPLUS_TIMEOUT")))
+    statement_timeout = atoi(ptr);
+  if ((ptr = getenv("GQLPLUS_LIMIT")))
+    row_limit = atoll(ptr);
+  if ((ptr = getenv("GQLPLUS_WARN_ROWS")))
+    warn_rows = atoll(ptr);
+  /*
+     Input that is not typed goes to sqlplus as it is, see
+     batch_sqlplus().
+     */
+  batch_mode = !isatty(STDIN_FILENO) && !getenv("EMACS_MODE");
+  if ((ptr = gqlplus_option(argv, "--parallel")))
+  {
+    argc -= 2;
+    parallel = atoi(ptr) ? atoi(ptr) : -1;
+  }
+  if ((fanout = gqlplus_option(argv, "--fanout")))
+    argc -= 2;
+  if ((estmt = gqlplus_option(argv, "-e")))
+    argc -= 2;
+  if ((ptr = gqlplus_option(argv, "--timeout")))
+  {
+    argc -= 2;
+    statement_timeout = atoi(ptr);
+  }
+  if ((replay = gqlplus_option(argv, "--replay")))
+    argc -= 2;
+  if ((ptr = gqlplus_option(argv, "--speed")))
+  {
+    argc -= 2;
+    speed = atof(ptr);
+  }
+  if (!batch_mode && !parallel && !fanout && !replay)
+    initialize_history("sqlplus");
   lptr = (FILE *) 0;
   /*lptr = open_log_file();*/
   editor = calloc(2, sizeof(char *));
@@ -2727,6 +7365,19 @@ int main(int argc, char **argv)
     argc--;
     progress = 1;
   }
+  if (gqlplus_switch(argv, "-ns") != argc)
+  {
+    argc--;
+    suggest_enabled = 0;
+  }
+  if (gqlplus_switch(argv, "-stop") != argc)
+  {
+    argc--;
+    stop_on_error = 1;
+  }
+
+  if (suggest_enabled)
+    rl_startup_hook = suggest_bind_keys;
   sig_init();
   status = pipe(fds1); /* parent to child pipe */
   pipe_size = fpathconf (fds1[0], _PC_PIPE_BUF);
@@ -2745,7 +7396,13 @@ int main(int argc, char **argv)
       if (path)
         path++;
       spath = stat_sqlplus(path);
-      if (spath)
+      if (spath && replay)
+        status = run_replay(replay, parallel ? parallel : 1, speed, argc, argv, spath, enx);
+      else if (spath && fanout)
+        status = run_fanout(fanout, estmt, parallel ? parallel : FANOUT_WORKERS, spath, enx);
+      else if (spath && parallel)
+        status = run_parallel(parallel, argc, argv, spath, enx);
+      else if (spath)
       {
         /*printf("sqlplus binary: %s\n", spath);*/
         /*
@@ -2754,7 +7411,9 @@ int main(int argc, char **argv)
         if (state != DISCONNECTED)
         {
           connect_string = get_connect_string(argc, argv);
-          sql_prompt = get_sql_prompt(sql_prompt, spath, connect_string, line, &pstat);
+          set_history_identity(connect_string);
+          if (!batch_mode)
+            sql_prompt = get_sql_prompt(sql_prompt, spath, connect_string, line, &pstat);
         }
         else
           sql_prompt = SQL_PROMPT;
@@ -2762,65 +7421,25 @@ int main(int argc, char **argv)
         {
           if (progress)
             printf("gqlplus: starting sqlplus...\n");
-          sqlplus_pid = fork();
-          if (sqlplus_pid == 0)
-          { 
-            /*
-               Child.
-               */
-            fd = dup2(fds1[0], STDIN_FILENO);
-            if (fd == STDIN_FILENO)
-            {
-              fd = dup2(fds2[1], STDOUT_FILENO);
-              if (fd == STDOUT_FILENO)
-              {
-                fptr2 = fdopen(STDOUT_FILENO, "w");
-                /*
-                   We have to disconnect sqlplus from
-                   controlling terminal. Otherwise,
-                   keyboard special keys (interrupt,
-                   delete, suspend) would go to sqlplus
-                   and disrupt it. See earlier comments
-                   for sigint_handler().
-                   */
-                status = (int) setsid();
-                xrgs = calloc(MAX_NARGS, sizeof(char *));
-                for (i = 1; i < argc; i++){
-                  xrgs[i] = argv[i];
-                }
-                xrgs[0] = spath;
-                if (execve(spath, xrgs, enx) < 0) 
-                {
-                  line = malloc(100);
-                  sprintf(line, "execve() failure; %s", spath);
-                  perror(line);
-                  status = -1;
-                }
-              }
-              else
-              {
-                perror("Child dup2() error:");
-                status = -1;
-              }
-            }
-            else
-            {
-              perror("Child dup2() error:");
-              status = -1;
-            }
+          xrgs = calloc(MAX_NARGS, sizeof(char *));
+          for (i = 1; i < argc; i++){
+            xrgs[i] = argv[i];
           }
-          else if (sqlplus_pid > 0)
+          xrgs[0] = spath;
+          sqlplus_pid = spawn_sqlplus(spath, xrgs, enx, fds1, fds2);
+          free(xrgs);
+          if (sqlplus_pid > 0)
           {
-            /*
-               fds1[1] is used to send messages to
-               sqlplus. fds2[0] is used to receive messages
-               from sqlplus.
-               */
-            close(fds1[0]);
             flags = fcntl(fds2[0], F_GETFL, 0);
             if (flags != -1)
             {
               /*fcntl(fds2[0], F_SETFL, (flags | O_NDELAY));*/
+              if (batch_mode && !quit_sqlplus)
+              {
+                stopped = batch_sqlplus(fds2[0], fds1[1], stop_on_error);
+                fds1[1] = -1;
+                quit_sqlplus = 1;
+              }
               /*
                  Print initial sqlplus message.
                  */
@@ -2831,6 +7450,7 @@ int main(int argc, char **argv)
                  */
               while (quit_sqlplus == 0)
               {
+                stmt = finish_statement(stmt, prompt, tod1);
                 /*
                    Disable echo if password prompt.
                    */
@@ -2855,7 +7475,18 @@ int main(int argc, char **argv)
                 /*
                    Read line from user and send it to sqlplus.
                    */
+                sqlplus_busy = 0;
+                arm_timeout(0);
+                drain_sessions();
+                check_jobs();
+                reap_compaction();
+                if (!check_numeric_prompt(prompt))
+                  end_limit();
                 tod2 = now();
+                sql_input = prompt && strcmp(prompt, USER_PROMPT) &&
+                  strncmp(prompt, VALUE_PROMPT, strlen(VALUE_PROMPT)) &&
+                  !check_password_prompt(prompt) && !check_numeric_prompt(prompt);
+                suggest_active = sql_input;
                 if (progress == 1)
                 {
                   prompt2=malloc(strlen(prompt)+100);
@@ -2865,18 +7496,93 @@ int main(int argc, char **argv)
                 }
                 else
                   rline = readline(prompt);
+                if (rline && sql_input)
+                  rline = read_statement(rline);
                 tod1 = now();
+                cancel_requested = 0;
+                timed_out = 0;
+                discarded_bytes = 0;
+                discarded_lines = 0;
+                sqlplus_busy = 1;
+                out_bytes = 0;
+                out_rows = -1;
+                out_error = 0;
                 if (rline)
                 {
+                  if (prompt && strcmp(prompt, USER_PROMPT) && !check_password_prompt(prompt))
+                  {
+                    stmt = add_statement_line(stmt, rline, prompt);
+                    if (stmt && !check_numeric_prompt(prompt))
+                      enter_history(stmt, tod1);
+                  }
+                  lline = lower_line(rline);
+                  len = strlen(rline);
+                  while ((len > 0) && (rline[len-1] == ' '))
+                    rline[--len] = '\0';
+                  oline = rline+strspn(rline, " ");
+                  cmd = classify_command(lline, (const char **) &nptr);
                   if (*rline)
                   {
-                    if (matchCommand(rline, szCmdPrefix, "rebuild") || 
-                        matchCommand(rline, szCmdPrefix, "r")) 
+                    if (cmd == CMD_REBUILD)
                       completion_names = 0; 
 
-                    if (matchCommand(rline, szCmdPrefix, "history") || 
-                        matchCommand(rline, szCmdPrefix, "h") 
-                       ) 
+                    if (cmd == CMD_MERGE)
+                      merge_history();
+
+                    if (cmd == CMD_SLOW)
+                      slow_history(nptr ? nptr : "");
+
+                    if (cmd == CMD_TIMEOUT)
+                      set_timeout(nptr);
+
+                    if (cmd == CMD_LIMIT)
+                      set_limit(nptr);
+
+                    if (cmd == CMD_MORE)
+                      rline = more_statement(rline);
+
+                    if (cmd == CMD_WARN)
+                      set_warn(nptr);
+
+                    if ((cmd == CMD_SELECT) && sql_input)
+                      rline = check_full_scan(rline);
+
+                    /*
+                       The command itself is a comment to sqlplus, so
+                       it goes on to the session that is now current
+                       and brings back its prompt.
+                       */
+                    if ((cmd == CMD_NEW) && sql_input)
+                      new_session(nptr ? oline+(nptr-lline) : (char *) 0, spath, enx,
+                          &connect_string, &completion_names, &all_tables);
+
+                    if ((cmd == CMD_SWITCH) && sql_input)
+                    {
+                      if (nptr)
+                        switch_session(atoi(nptr), &connect_string, &completion_names, &all_tables);
+                      else
+                        printf("Usage: %sswitch n\n", szCmdPrefix);
+                    }
+
+                    if (cmd == CMD_LIST)
+                      list_sessions();
+
+                    if ((cmd == CMD_BG) && sql_input)
+                      bg_statement(nptr ? oline+(nptr-lline) : (char *) 0, spath, enx, connect_string);
+
+                    if (cmd == CMD_JOBS)
+                      list_jobs();
+
+                    if (cmd == CMD_CAPTURE)
+                      set_capture(nptr ? oline+(nptr-lline) : (char *) 0);
+
+                    if ((cmd == CMD_WATCH) && sql_input)
+                      watch_statement(nptr ? oline+(nptr-lline) : (char *) 0, fds2[0], fds1[1], line);
+
+                    if ((cmd == CMD_EXPORT) && sql_input)
+                      export_table(nptr ? oline+(nptr-lline) : (char *) 0, spath, enx, connect_string, line);
+
+                    if (cmd == CMD_HISTORY)
                     {
                       HIST_ENTRY** ppHistEntry = history_list();
                       if (ppHistEntry != (HIST_ENTRY**) 0) 
@@ -2902,22 +7608,13 @@ int main(int argc, char **argv)
                       else
                         password = strdup(rline);
                       connect_string = build_connect_string(username, password);
+                      set_history_identity(connect_string);
                       sql_prompt = 
                         get_sql_prompt(sql_prompt, spath, connect_string, line, &pstat);
                     }
-                    else if (!check_password_prompt(prompt))
-                      add_history(rline);
                   }
-                  lline = tl(rline);
-                  oline = trim(rline);
-                  nptr = lline+strcspn(lline, WHITESPACE); /* pointer to first parameter */
-                  nptr += strspn(nptr, WHITESPACE);
-                  if (!strlen(nptr))
-                    nptr = (char *) 0;
                   status = 0;
-                  xrgs = str_tokenize(lline, " \t");
-                  if (!strncmp(lline, SET_CMD, strlen(SET_CMD)) && xrgs && xrgs[1] &&
-                      !strncmp(xrgs[1], SQLPROMPT_CMD, 4))
+                  if ((cmd == CMD_SET) && nptr && !strncmp(nptr, SQLPROMPT_CMD, 4))
                   {
                     write(fds1[1], rline, strlen(rline));
                     write(fds1[1], "\n", 1);
@@ -2930,38 +7627,60 @@ int main(int argc, char **argv)
                        Detect change of state
                        (STARTUP/CONNECTED/DISCONNECTED).
                        */
-                    if (!strncmp(lline, CONNECT_CMD, 4))
+                    if (cmd == CMD_CONNECT)
                     {
                       state = CONNECTED;
                       if (!username)
                       {
                         tokens = str_tokenize(oline,WHITESPACE);
                         connect_string = get_connect_string(2,tokens);
-                        free(tokens);
+                        set_history_identity(connect_string);
+                        str_free(tokens);
                       }
                     }
-                    if (!strncmp(lline, DISCONNECT_CMD, 4))
+                    if (cmd == CMD_DISCONNECT)
                       state = DISCONNECTED;
 
-                    if (!strncmp(lline, PAUSE_CMD, 3))
+                    if (cmd == CMD_PAUSE)
                       pause_cmd(fds2[0], fds1[1], rline, sql_prompt, 1);
-                    else if (!strcmp(lline, QUIT_CMD) && (state != STARTUP))
+                    else if ((cmd == CMD_QUIT) && (state != STARTUP))
                     {
+                      /*
+                         Let sqlplus quit the way it was asked to;
+                         get_final_sqlplus() collects the rest.
+                         */
+                      write(fds1[1], rline, strlen(rline));
+                      write(fds1[1], "\n", 1);
                       quit_sqlplus = 1;
-                      kill_sqlplus();
                     }
-                    else if (pause_mode && !strncmp(lline, SELECT_CMD, strlen(SELECT_CMD)))
+                    else if (pause_mode && (cmd == CMD_SELECT))
+                    {
+                      for (ptr = rline; (ptr = strchr(ptr, '\n')); ptr++)
+                        pending_prompts++;
+                      mirror_sql_buffer(rline, sql_input);
                       pause_cmd(fds2[0], fds1[1], rline, sql_prompt, 0);
-                    else if (xrgs && xrgs[1] && !strncmp(lline, SET_CMD, strlen(SET_CMD)) &&
-                        !strncmp(xrgs[1], PAUSE_CMD, 3))
+                    }
+                    else if ((cmd == CMD_SET) && nptr && !strncmp(nptr, PAUSE_CMD, 3))
                     {
-                      write(fds1[1], rline, strlen(rline));
-                      if (xrgs[2] && !strcmp(xrgs[2], ON_CMD))
+                      ptr = nptr+strcspn(nptr, WHITESPACE);
+                      ptr += strspn(ptr, WHITESPACE);
+                      len = strlen(ON_CMD);
+                      /*
+                         Paging is done by pause_cmd(), so sqlplus
+                         itself is never left waiting for Enter.
+                         */
+                      if (!strncmp(ptr, ON_CMD, len) && ((ptr[len] == '\0') || strchr(WHITESPACE, ptr[len])))
+                      {
                         pause_mode = 1;
+                        write(fds1[1], PAUSE_OFF_CMD, strlen(PAUSE_OFF_CMD));
+                      }
                       else
+                      {
                         pause_mode = 0;
+                        write(fds1[1], rline, strlen(rline));
+                      }
                     }
-                    else if (strncmp(lline, EDIT_CMD, 2) == 0)
+                    else if (cmd == CMD_EDIT)
                     {
                       if (editor[0])
                         status = edit(fds2[0], fds1[1], line, editor, nptr);
@@ -2974,7 +7693,7 @@ int main(int argc, char **argv)
                        it locally, not transmit to
                        sqlplus.
                        */
-                    else if (!strncmp(lline, CLEAR_CMD, 2) && nptr &&
+                    else if ((cmd == CMD_CLEAR) && nptr &&
                         !strncmp(nptr, SCREEN, strlen(SCREEN)))
                       system("clear");
                     else if (!check_numeric_prompt(prompt) && (shellcmd = get_shellcmd(oline)))
@@ -2986,6 +7705,22 @@ int main(int argc, char **argv)
                       if (check_password_prompt(prompt)){
                         status = tcsetattr(STDIN_FILENO, TCSAFLUSH, &save_termios);
                       }
+                      /*
+                         A recalled multi-line statement goes out in
+                         a single write.
+                         */
+                      for (ptr = rline; (ptr = strchr(ptr, '\n')); ptr++)
+                        pending_prompts++;
+                      if (sql_input || check_numeric_prompt(prompt))
+                        mirror_sql_buffer(rline, sql_input);
+                      /*
+                         ACCEPT waits for the user, who has all the
+                         time in the world.
+                         */
+                      if (sql_input && (cmd != CMD_ACCEPT))
+                        arm_timeout(1);
+                      if (sql_input && ((cmd == CMD_SELECT) || (cmd == CMD_MORE)))
+                        arm_limit(rline, cmd == CMD_SELECT);
                       write(fds1[1], rline, strlen(rline));
                       if (strstr(lline, DEFINE_CMD) && (strstr(lline, EDITOR))){
                         editor = set_editor(lline);
@@ -3001,11 +7736,14 @@ int main(int argc, char **argv)
 
                            //ACCEPT command requires special processing.
 
-                        if (!strncmp(lline, ACCEPT_CMD, 3)){
-                          prompt = accept_cmd(lline, fds2[0], fds1[1], sql_prompt, line);
+                        if (cmd == CMD_ACCEPT){
+                          prompt = accept_cmd(rline, fds2[0], fds1[1], sql_prompt, line);
                         }else{
                           prompt = get_sqlplus(fds2[0], line, (char **) 0);
-                          if (!strncmp(lline, CONNECT_CMD, 4)){
+                          stmt = finish_statement(stmt, prompt, tod1);
+                          if (check_numeric_prompt(prompt))
+                            sql_buffer = sfree(sql_buffer);
+                          if (cmd == CMD_CONNECT){
                             /*
                                In case of CONNECT command, rescan tables.
                                */
@@ -3015,21 +7753,24 @@ int main(int argc, char **argv)
                       }
                     }
                   }
-                  str_free(xrgs);
                   free(rline);
-                  free(lline);
+                  if (quit_sqlplus && (nsessions > 1))
+                    prompt = close_session(line, &connect_string, &completion_names, &all_tables);
                 }
                 else
-                {
                   quit_sqlplus = 1;
-                  kill_sqlplus();
-                }
               }
+              if (stmt)
+                record_history(stmt, tod1);
               /*
                  Quitting. Get the remaining output sent
                  from sqlplus, if any.
                  */
-              get_final_sqlplus(fds2[0]);
+              status = get_final_sqlplus(fds2[0], fds1[1]);
+              end_sessions();
+              end_jobs();
+              if (stopped)
+                status = 1;
             }
             else
               status = -1;
@@ -79,4 +79,11 @@ extern char *strchr ();
 /* Some variable definitions shared across history source files. */
 extern int history_offset;
 
+/* histsearch.c */
+extern void _hs_index_append PARAMS((const char *));
+extern void _hs_index_shift PARAMS((int));
+extern void _hs_index_replace PARAMS((int, const char *));
+extern void _hs_index_invalidate PARAMS((void));
+extern int _hs_index_candidate PARAMS((const char *, int, int, int));
+
 #endif /* !_HISTLIB_H_ */
@@ -112,6 +112,7 @@ history_set_history_state (state)
   history_size = state->size;
   if (state->flags & HS_STIFLED)
     history_stifled = 1;
+  _hs_index_invalidate ();
 }
 
 /* Begin a session in which the history functions might be used.  This
@@ -235,6 +236,7 @@ add_history (string)
 	the_history[i] = the_history[i + 1];
 
       history_base++;
+      _hs_index_shift (1);
     }
   else
     {
@@ -262,6 +264,7 @@ add_history (string)
 
   the_history[history_length] = (HIST_ENTRY *)NULL;
   the_history[history_length - 1] = temp;
+  _hs_index_append (temp->line);
 }
 
 /* Make the history entry at WHICH have LINE and DATA.  This returns
@@ -284,6 +287,7 @@ replace_history_entry (which, line, data)
   temp->line = savestring (line);
   temp->data = data;
   the_history[which] = temp;
+  _hs_index_replace (which, temp->line);
 
   return (old_value);
 }
@@ -308,6 +312,7 @@ remove_history (which)
 	the_history[i] = the_history[i + 1];
 
       history_length--;
+      _hs_index_invalidate ();
     }
 
   return (return_value);
@@ -337,6 +342,7 @@ stifle_history (max)
 	the_history[j] = the_history[i];
       the_history[j] = (HIST_ENTRY *)NULL;
       history_length = j;
+      _hs_index_shift (i - j);
     }
 
   history_stifled = 1;
@@ -378,4 +384,5 @@ clear_history ()
     }
 
   history_offset = history_length = 0;
+  _hs_index_invalidate ();
 }
@@ -43,12 +43,270 @@
 #include "history.h"
 #include "histlib.h"
 
+#include "xmalloc.h"
+
 /* The list of alternate characters that can delimit a history search
    string. */
 char *history_search_delimiter_chars = (char *)NULL;
 
 static int history_search_internal PARAMS((const char *, int, int));
 
+/* **************************************************************** */
+/*								    */
+/*			History Trigram Index			    */
+/*								    */
+/* **************************************************************** */
+
+/* Every history line is indexed by the trigrams (three consecutive
+   bytes) it contains.  Each trigram hashes into one of HS_NGRAM_BUCKETS
+   posting lists holding the absolute numbers of the entries that
+   contain it, in ascending order.  A search string of at least three
+   characters can only occur in a line whose number appears in the
+   posting list of every one of its trigrams, so a search only has to
+   verify those candidates instead of scanning every line.  Hash
+   collisions merely produce extra candidates.
+
+   Absolute entry numbers never change: HS_FIRST is the number of
+   the_history[0], and entries dropped off the front of a stifled
+   history simply fall below it.  Anything that reorders the list
+   invalidates the index, which is then rebuilt by the next search. */
+
+#define HS_NGRAM_BITS		16
+#define HS_NGRAM_BUCKETS	(1 << HS_NGRAM_BITS)
+#define HS_NGRAM_HASH(s) \
+  ((((unsigned char)(s)[0] * 0x9E37U) ^ ((unsigned char)(s)[1] * 0x85EBU) ^ \
+    ((unsigned char)(s)[2] * 0xC2B3U)) & (HS_NGRAM_BUCKETS - 1))
+#define HS_NGRAM_MAX		32	/* trigrams of the search string checked */
+
+struct _hs_posting {
+  int *pos;
+  int len;
+  int size;
+};
+
+static void hs_index_rebuild PARAMS((void));
+static void hs_index_post PARAMS((int, const char *));
+static void hs_index_compact PARAMS((void));
+static int hs_posting_find PARAMS((struct _hs_posting *, int));
+static int hs_posting_has PARAMS((struct _hs_posting *, int));
+
+static struct _hs_posting *hs_index = (struct _hs_posting *)NULL;
+static int hs_index_valid;	/* Zero means rebuild before use. */
+static int hs_first;		/* Absolute number of the_history[0]. */
+static int hs_next;		/* Absolute number of the next entry. */
+static int hs_stale;		/* Dropped entries still in posting lists. */
+
+/* Add the absolute entry number N to the posting list of every trigram
+   in LINE, keeping the lists sorted. */
+static void
+hs_index_post (n, line)
+     int n;
+     const char *line;
+{
+  register struct _hs_posting *p;
+  register int i;
+
+  for (; line[0] && line[1] && line[2]; line++)
+    {
+      p = &hs_index[HS_NGRAM_HASH (line)];
+      if (p->len && p->pos[p->len - 1] >= n)
+	{
+	  /* Out-of-order insert (replace_history_entry) or a trigram
+	     already posted for this line. */
+	  i = hs_posting_find (p, n);
+	  if (i < p->len && p->pos[i] == n)
+	    continue;
+	}
+      else
+	i = p->len;
+
+      if (p->len == p->size)
+	{
+	  p->size = p->size ? p->size * 2 : 4;
+	  p->pos = (int *)xrealloc (p->pos, p->size * sizeof (int));
+	}
+      if (i < p->len)
+	memmove (p->pos + i + 1, p->pos + i, (p->len - i) * sizeof (int));
+      p->pos[i] = n;
+      p->len++;
+    }
+}
+
+/* Return the index of the first element of P that is >= N. */
+static int
+hs_posting_find (p, n)
+     struct _hs_posting *p;
+     int n;
+{
+  register int lo, hi, mid;
+
+  lo = 0;
+  hi = p->len;
+  while (lo < hi)
+    {
+      mid = (lo + hi) / 2;
+      if (p->pos[mid] < n)
+	lo = mid + 1;
+      else
+	hi = mid;
+    }
+  return (lo);
+}
+
+static int
+hs_posting_has (p, n)
+     struct _hs_posting *p;
+     int n;
+{
+  int i;
+
+  i = hs_posting_find (p, n);
+  return (i < p->len && p->pos[i] == n);
+}
+
+/* Drop the numbers of entries that have fallen off the front of the
+   history from every posting list. */
+static void
+hs_index_compact ()
+{
+  register int b, i;
+  register struct _hs_posting *p;
+
+  for (b = 0; b < HS_NGRAM_BUCKETS; b++)
+    {
+      p = &hs_index[b];
+      if (p->len == 0 || p->pos[0] >= hs_first)
+	continue;
+      i = hs_posting_find (p, hs_first);
+      p->len -= i;
+      memmove (p->pos, p->pos + i, p->len * sizeof (int));
+    }
+  hs_stale = 0;
+}
+
+static void
+hs_index_rebuild ()
+{
+  register int i;
+  HIST_ENTRY **the_history;
+
+  if (hs_index == 0)
+    hs_index = (struct _hs_posting *)xmalloc (HS_NGRAM_BUCKETS * sizeof (struct _hs_posting));
+  else
+    for (i = 0; i < HS_NGRAM_BUCKETS; i++)
+      free (hs_index[i].pos);
+  memset (hs_index, 0, HS_NGRAM_BUCKETS * sizeof (struct _hs_posting));
+
+  the_history = history_list ();
+  hs_first = 0;
+  for (i = 0; i < history_length; i++)
+    hs_index_post (i, the_history[i]->line);
+  hs_next = history_length;
+  hs_stale = 0;
+  hs_index_valid = 1;
+}
+
+/* Called by add_history () after LINE has been stored as the last
+   entry of the history list.  An index that is started on an empty
+   list is kept up to date from then on. */
+void
+_hs_index_append (line)
+     const char *line;
+{
+  if (hs_index_valid)
+    hs_index_post (hs_next++, line);
+  else if (history_length == 1)
+    hs_index_rebuild ();
+}
+
+/* Called when COUNT entries have been removed from the front of the
+   history list. */
+void
+_hs_index_shift (count)
+     int count;
+{
+  if (hs_index_valid == 0)
+    return;
+  hs_first += count;
+  hs_stale += count;
+  /* Keep the dead weight in the posting lists below the live size. */
+  if (hs_stale > history_length + HS_NGRAM_BUCKETS / 64)
+    hs_index_compact ();
+}
+
+/* Called by replace_history_entry () with the new contents of entry
+   WHICH.  The old trigrams stay posted; they only cost a verification. */
+void
+_hs_index_replace (which, line)
+     int which;
+     const char *line;
+{
+  if (hs_index_valid)
+    hs_index_post (hs_first + which, line);
+}
+
+/* Called when the history list has been changed in a way the index
+   cannot follow. */
+void
+_hs_index_invalidate ()
+{
+  hs_index_valid = 0;
+}
+
+/* Return the offset of the first history entry at or beyond FROM, in
+   DIRECTION, which may contain the LEN characters of STRING, or -1 if
+   there is none.  Strings too short to have a trigram cannot be
+   filtered, so FROM itself is returned. */
+int
+_hs_index_candidate (string, len, from, direction)
+     const char *string;
+     int len, from, direction;
+{
+  struct _hs_posting *lists[HS_NGRAM_MAX], *p;
+  int nlists, i, j, k, n;
+
+  if (from < 0 || from >= history_length)
+    return (-1);
+  if (len < 3)
+    return (from);
+
+  if (hs_index_valid == 0)
+    hs_index_rebuild ();
+
+  /* Collect the posting lists of the search string, rarest first. */
+  for (nlists = i = 0; i + 2 < len && nlists < HS_NGRAM_MAX; i++)
+    {
+      p = &hs_index[HS_NGRAM_HASH (string + i)];
+      if (p->len == 0)
+	return (-1);
+      for (j = 0; j < nlists && lists[j] != p; j++)
+	;
+      if (j < nlists)
+	continue;
+      for (j = nlists++; j > 0 && lists[j - 1]->len > p->len; j--)
+	lists[j] = lists[j - 1];
+      lists[j] = p;
+    }
+
+  /* Walk the rarest list from FROM and return the first entry that
+     every other list agrees on. */
+  p = lists[0];
+  k = hs_posting_find (p, hs_first + from);
+  if (direction < 0 && (k == p->len || p->pos[k] != hs_first + from))
+    k--;
+  for (; k >= 0 && k < p->len; k += (direction < 0) ? -1 : 1)
+    {
+      n = p->pos[k];
+      if (n < hs_first)
+	break;
+      for (j = 1; j < nlists && hs_posting_has (lists[j], n); j++)
+	;
+      if (j == nlists)
+	return (n - hs_first);
+    }
+  return (-1);
+}
+
 /* Search the history for STRING, starting at history_offset.
    If DIRECTION < 0, then the search is through previous entries, else
    through subsequent.  If ANCHORED is non-zero, the string must
@@ -95,6 +353,11 @@ history_search_internal (string, direction, anchored)
       if ((reverse && i < 0) || (!reverse && i == history_length))
 	return (-1);
 
+      /* Skip straight to the next line that can contain STRING. */
+      i = _hs_index_candidate (string, string_len, i, direction);
+      if (i < 0)
+	return (-1);
+
       line = the_history[i]->line;
       line_index = strlen (line);
 
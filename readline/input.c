@@ -96,7 +96,7 @@ static int rl_gather_tyi PARAMS((void));
 /* **************************************************************** */
 
 static int pop_index, push_index;
-static unsigned char ibuffer[512];
+static unsigned char ibuffer[4096];
 static int ibuffer_len = sizeof (ibuffer) - 1;
 
 #define any_typein (push_index != pop_index)
@@ -154,9 +154,30 @@ _rl_unget_char (key)
   return (0);
 }
 
-/* If a character is available to be read, then read it and stuff it into
-   IBUFFER.  Otherwise, just return.  Returns number of characters read
-   (0 if none available) and -1 on error (EIO). */
+/* Read whatever input is available, up to the free space in IBUFFER,
+   with a single read(2), and stuff it into IBUFFER.  The terminal is in
+   non-canonical mode, so this only blocks if nothing has been typed.
+   Returns the result of read(2). */
+static int
+ibuffer_fill (tty)
+     int tty;
+{
+  unsigned char input[sizeof (ibuffer)];
+  int space, result, i;
+
+  space = ibuffer_space ();
+  if (space == 0)
+    return 0;
+  result = read (tty, input, space);
+  for (i = 0; i < result; i++)
+    rl_stuff_char (input[i]);
+  return result;
+}
+
+/* If characters are available to be read, then read all of them that
+   fit and stuff them into IBUFFER.  Otherwise, just return.  Returns
+   number of characters read (0 if none available) and -1 on error
+   (EIO). */
 static int
 rl_gather_tyi ()
 {
@@ -171,6 +192,26 @@ rl_gather_tyi ()
 
   tty = fileno (rl_instream);
 
+  /* Everything readline reads itself is read in bulk. */
+  if (rl_getc_function == rl_getc)
+    {
+#if defined (HAVE_SELECT)
+      FD_ZERO (&readfds);
+      FD_ZERO (&exceptfds);
+      FD_SET (tty, &readfds);
+      FD_SET (tty, &exceptfds);
+      timeout.tv_sec = 0;
+      timeout.tv_usec = _keyboard_input_timeout;
+      if (select (tty + 1, &readfds, (fd_set *)NULL, &exceptfds, &timeout) <= 0)
+	return 0;
+      errno = 0;
+      result = ibuffer_fill (tty);
+      if (result == -1 && errno == EIO)
+	return -1;
+      return (result > 0);
+#endif
+    }
+
 #if defined (HAVE_SELECT)
   FD_ZERO (&readfds);
   FD_ZERO (&exceptfds);
@@ -266,6 +307,10 @@ _rl_input_available ()
 #endif
   int tty;
 
+  /* Input read ahead is waiting in IBUFFER. */
+  if (any_typein)
+    return 1;
+
   tty = fileno (rl_instream);
 
 #if defined (HAVE_SELECT)
@@ -365,6 +410,111 @@ rl_clear_pending_input ()
   return 0;
 }
 
+/* **************************************************************** */
+/*								    */
+/*			  Bracketed Paste			    */
+/*								    */
+/* **************************************************************** */
+
+/* Read pasted text up to the BRACK_PASTE_SUFF the terminal sends after
+   it.  The text is read in blocks, straight into a buffer that grows
+   geometrically, instead of one key (and one read) at a time.  Bytes
+   read past the end of the paste are put back into IBUFFER.  Returns
+   the text, without the suffix and with carriage returns turned into
+   newlines, and its length in *LENP. */
+char *
+_rl_bracketed_text (lenp)
+     int *lenp;
+{
+  int tty, c, len, size, n, i, j;
+  char *buf;
+
+  size = ibuffer_len + 1;
+  buf = (char *)xmalloc (size);
+  len = 0;
+  tty = fileno (rl_instream);
+
+  RL_SETSTATE (RL_STATE_MOREINPUT);
+  for (;;)
+    {
+      if (len + ibuffer_len >= size)
+	{
+	  while (len + ibuffer_len >= size)
+	    size *= 2;
+	  buf = (char *)xrealloc (buf, size);
+	}
+
+      /* What has been queued up already comes first. */
+      if (rl_get_char (&c))
+	{
+	  buf[len++] = c;
+	  n = 1;
+	}
+      else if (rl_getc_function == rl_getc && rl_pending_input == 0)
+	{
+	  n = read (tty, buf + len, ibuffer_len);
+	  if (n < 0 && errno == EINTR)
+	    continue;
+	  if (n <= 0)
+	    break;
+	  len += n;
+	}
+      else
+	{
+	  c = rl_read_key ();
+	  if (c < 0)
+	    break;
+	  buf[len++] = c;
+	  n = 1;
+	}
+
+      /* Look for the suffix in what was just added. */
+      i = len - n - (BRACK_PASTE_SLEN - 1);
+      for (i = i < 0 ? 0 : i; i + BRACK_PASTE_SLEN <= len; i++)
+	if (buf[i] == ESC && STREQN (buf + i, BRACK_PASTE_SUFF, BRACK_PASTE_SLEN))
+	  break;
+      if (i + BRACK_PASTE_SLEN <= len)
+	{
+	  for (j = i + BRACK_PASTE_SLEN; j < len; j++)
+	    rl_stuff_char ((unsigned char)buf[j]);
+	  len = i;
+	  break;
+	}
+    }
+  RL_UNSETSTATE (RL_STATE_MOREINPUT);
+
+  for (i = j = 0; i < len; i++)
+    {
+      if (buf[i] == '\r')
+	{
+	  if (i + 1 < len && buf[i + 1] == '\n')
+	    continue;
+	  buf[i] = '\n';
+	}
+      buf[j++] = buf[i];
+    }
+  buf[j] = '\0';
+  *lenp = j;
+  return buf;
+}
+
+/* Bound to BRACK_PASTE_PREF: insert everything up to the end of the
+   paste as a single piece of text, with a single undo record and a
+   single redisplay, no matter how many lines were pasted. */
+int
+rl_bracketed_paste_begin (count, key)
+     int count, key;
+{
+  int len;
+  char *buf;
+
+  buf = _rl_bracketed_text (&len);
+  if (len > 0)
+    rl_insert_text (buf);
+  free (buf);
+  return 0;
+}
+
 /* **************************************************************** */
 /*								    */
 /*			     Character Input			    */
@@ -407,8 +557,15 @@ rl_read_key ()
 	}
       else
 	{
+	  /* Read everything that has been typed ahead in one go; fall
+	     back to rl_getc to handle errors and end of file. */
 	  if (rl_get_char (&c) == 0)
-	    c = (*rl_getc_function) (rl_instream);
+	    {
+	      if (rl_getc_function != rl_getc ||
+		  ibuffer_fill (fileno (rl_instream)) <= 0 ||
+		  rl_get_char (&c) == 0)
+		c = (*rl_getc_function) (rl_instream);
+	    }
 	}
     }
 
@@ -49,6 +49,7 @@
 
 #include "readline.h"
 #include "history.h"
+#include "histlib.h"
 
 #include "rlprivate.h"
 #include "xmalloc.h"
@@ -471,6 +472,16 @@ rl_search_history (direction, invoking_key)
 	      /* Move to the next line. */
 	      i += direction;
 
+	      /* Let the history index skip lines that cannot match.  The
+		 last element of LINES is the line being edited, which is
+		 not part of the history list. */
+	      if (i >= 0 && i < hlen - 1)
+		{
+		  i = _hs_index_candidate (search_string, search_string_index, i, direction);
+		  if (i < 0 && reverse == 0)
+		    i = hlen - 1;
+		}
+
 	      /* At limit for direction? */
 	      if (reverse ? (i < 0) : (i == hlen))
 		{
@@ -117,6 +117,9 @@ int rl_dispatching;
 /* Non-zero if the previous command was a kill command. */
 int _rl_last_command_was_kill = 0;
 
+/* Non-zero if redisplay was put off because more input was queued. */
+int _rl_want_redisplay = 0;
+
 /* The current value of the numeric argument specified by the user. */
 int rl_numeric_arg = 1;
 
@@ -461,8 +464,14 @@ readline_internal_charloop ()
           rl_newline (1, '\n');
         }
 
+      /* Input that is queued up already will be dispatched right away:
+	 redisplay once it has all been handled. */
       if (rl_done == 0)
-	(*rl_redisplay_function) ();
+	{
+	  _rl_want_redisplay = _rl_any_typein () && RL_ISSTATE (RL_STATE_MACROINPUT) == 0;
+	  if (_rl_want_redisplay == 0)
+	    (*rl_redisplay_function) ();
+	}
 
       /* If the application writer has told us to erase the entire line if
 	  the only character typed was something bound to rl_newline, do so. */
@@ -881,6 +890,8 @@ bind_arrow_keys_internal (map)
   _rl_bind_if_unbound ("\033OH", rl_beg_of_line);
   _rl_bind_if_unbound ("\033OF", rl_end_of_line);
 
+  _rl_bind_if_unbound (BRACK_PASTE_PREF, rl_bracketed_paste_begin);
+
   _rl_keymap = xkeymap;
 }
 
@@ -110,6 +110,7 @@ extern int rl_rubout_or_delete PARAMS((int, int));
 extern int rl_delete_horizontal_space PARAMS((int, int));
 extern int rl_delete_or_show_completions PARAMS((int, int));
 extern int rl_insert_comment PARAMS((int, int));
+extern int rl_bracketed_paste_begin PARAMS((int, int));
 
 /* Bindable commands for changing case. */
 extern int rl_upcase_word PARAMS((int, int));
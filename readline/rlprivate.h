@@ -89,6 +89,15 @@ extern char *_rl_savestring PARAMS((const char *));
    between files in the readline library, but are not intended
    to be visible to readline callers. */
 
+/* Sequences a terminal in bracketed paste mode sends around pasted text,
+   and the ones that turn the mode on and off. */
+#define BRACK_PASTE_PREF	"\033[200~"
+#define BRACK_PASTE_SUFF	"\033[201~"
+#define BRACK_PASTE_SLEN	6
+
+#define BRACK_PASTE_INIT	"\033[?2004h"
+#define BRACK_PASTE_FINI	"\033[?2004l"
+
 /*************************************************************************
  * Undocumented private functions					 *
  *************************************************************************/
@@ -131,6 +140,7 @@ extern int _rl_input_available PARAMS((void));
 extern int _rl_input_queued PARAMS((int));
 extern void _rl_insert_typein PARAMS((int));
 extern int _rl_unget_char PARAMS((int));
+extern char *_rl_bracketed_text PARAMS((int *));
 
 /* macro.c */
 extern void _rl_with_macro_input PARAMS((char *));
@@ -174,6 +184,7 @@ extern void _rl_output_some_chars PARAMS((const char *, int));
 extern int _rl_backspace PARAMS((int));
 extern void _rl_enable_meta_key PARAMS((void));
 extern void _rl_control_keypad PARAMS((int));
+extern void _rl_control_bracketed_paste PARAMS((int));
 extern void _rl_set_cursor PARAMS((int, int));
 
 /* text.c */
@@ -255,11 +266,13 @@ extern Keymap _rl_keymap;
 extern FILE *_rl_in_stream;
 extern FILE *_rl_out_stream;
 extern int _rl_last_command_was_kill;
+extern int _rl_want_redisplay;
 extern int _rl_eof_char;
 extern procenv_t readline_top_level;
 
 /* terminal.c */
 extern int _rl_enable_keypad;
+extern int _rl_enable_bracketed_paste;
 extern int _rl_enable_meta;
 extern char *_rl_term_clreol;
 extern char *_rl_term_clrpag;
@@ -665,6 +665,9 @@ rl_prep_terminal (meta_flag)
   if (_rl_enable_keypad)
     _rl_control_keypad (1);
 
+  if (_rl_enable_bracketed_paste)
+    _rl_control_bracketed_paste (1);
+
   fflush (rl_outstream);
   terminal_prepped = 1;
   RL_SETSTATE(RL_STATE_TERMPREPPED);
@@ -689,6 +692,9 @@ rl_deprep_terminal ()
   if (_rl_enable_keypad)
     _rl_control_keypad (0);
 
+  if (_rl_enable_bracketed_paste)
+    _rl_control_bracketed_paste (0);
+
   fflush (rl_outstream);
 
   if (set_tty_settings (tty, &otio) < 0)
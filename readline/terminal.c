@@ -154,12 +154,19 @@ static char *_rl_term_ve;	/* normal */
 
 static void bind_termcap_arrow_keys PARAMS((Keymap));
 
+/* Non-zero if TERM is `dumb': no escape sequences are sent. */
+static int term_is_dumb;
+
 /* Variables that hold the screen dimensions, used by the display code. */
 int _rl_screenwidth, _rl_screenheight, _rl_screenchars;
 
 /* Non-zero means the user wants to enable the keypad. */
 int _rl_enable_keypad;
 
+/* Non-zero means to ask the terminal to bracket pasted text, so that it
+   can be inserted all at once. */
+int _rl_enable_bracketed_paste = 1;
+
 /* Non-zero means the user wants to enable a meta key. */
 int _rl_enable_meta = 1;
 
@@ -371,6 +378,7 @@ _rl_init_terminal_io (terminal_name)
 
   if (term == 0)
     term = "dumb";
+  term_is_dumb = STREQ (term, "dumb");
 
   /* I've separated this out for later work on not calling tgetent at all
      if the calling application has supplied a custom redisplay function,
@@ -635,6 +643,15 @@ _rl_control_keypad (on)
 #endif
 }
 
+void
+_rl_control_bracketed_paste (on)
+     int on;
+{
+  if (term_is_dumb)
+    return;
+  fputs (on ? BRACK_PASTE_INIT : BRACK_PASTE_FINI, rl_outstream);
+}
+
 /* **************************************************************** */
 /*								    */
 /*	 		Controlling the Cursor			    */
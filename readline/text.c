@@ -887,7 +887,12 @@ rl_newline (count, key)
     return 0;
 
   if (readline_echoing_p)
-    _rl_update_final ();
+    {
+      if (_rl_want_redisplay)
+	(*rl_redisplay_function) ();
+      _rl_update_final ();
+    }
+  _rl_want_redisplay = 0;
   return 0;
 }
 
@@ -142,9 +142,12 @@ void
 rl_extend_line_buffer (len)
      int len;
 {
-  while (len >= rl_line_buffer_len)
+  /* Grow geometrically, so that inserting a large paste or a long
+     history entry does not copy the buffer over and over. */
+  if (len >= rl_line_buffer_len)
     {
-      rl_line_buffer_len += DEFAULT_BUFFER_SIZE;
+      while (len >= rl_line_buffer_len)
+	rl_line_buffer_len = rl_line_buffer_len ? 2 * rl_line_buffer_len : DEFAULT_BUFFER_SIZE;
       rl_line_buffer = (char *)xrealloc (rl_line_buffer, rl_line_buffer_len);
     }
 